@@ -0,0 +1,172 @@
+#include "../src/cache.hpp"
+#include "stub_storage.hpp"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// LRUCache over an in-memory StubStorage, so the numbers are the cache's
+// own and no database is needed.
+
+namespace {
+
+using Cache = LRUCache<std::string, std::string>;
+
+const size_t KEY_COUNT = 4096;
+
+std::unique_ptr<Cache> cache;
+std::vector<std::string> keys;
+
+std::unique_ptr<Cache> make_cache(size_t capacity, size_t shards) {
+  return std::make_unique<Cache>(capacity, std::chrono::seconds(3600), shards,
+                                 0, std::make_unique<StubStorage>());
+}
+
+// Key i padded to `size` bytes, so key size varies without changing how
+// keys hash or compare beyond their length.
+std::string make_key(size_t i, size_t size) {
+  std::string key = "key:" + std::to_string(i);
+  if (key.size() < size) {
+    key.resize(size, '.');
+  }
+  return key;
+}
+
+// xorshift: cheap uniform key choice that defeats prefetching.
+uint64_t next_random(uint64_t &bits) {
+  bits ^= bits << 13;
+  bits ^= bits >> 7;
+  bits ^= bits << 17;
+  return bits;
+}
+
+void setup(size_t shards) {
+  cache = make_cache(KEY_COUNT, shards);
+  keys.clear();
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    keys.push_back("key:" + std::to_string(i));
+    cache->put(keys.back(), "value:" + std::to_string(i));
+  }
+}
+
+// Read-only hits spread over every shard: measures lock contention as
+// threads are added. range(0) is the shard count; 1 is the unsharded
+// baseline.
+void BM_ConcurrentGet(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    setup(state.range(0));
+  }
+
+  std::string value;
+  size_t i = state.thread_index() * 7919;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cache->get(keys[i++ % KEY_COUNT], value));
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    state.counters["shards"] = cache->shard_count();
+    cache.reset();
+  }
+}
+BENCHMARK(BM_ConcurrentGet)
+    ->Arg(1)
+    ->Arg(16)
+    ->ThreadRange(1, 32)
+    ->UseRealTime();
+
+// Fills a shared cache with range(0) entries whose keys are range(1) bytes.
+void fill(benchmark::State &state) {
+  size_t capacity = state.range(0);
+  cache = make_cache(capacity, Cache::DEFAULT_SHARDS);
+  keys.clear();
+  keys.reserve(capacity);
+  for (size_t i = 0; i < capacity; i++) {
+    keys.push_back(make_key(i, state.range(1)));
+    cache->load(keys.back(), std::string(64, 'v'));
+  }
+}
+
+// Hits on uniformly random keys. range(0) is the capacity, all of it
+// filled, and range(1) the key size.
+void BM_Get(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    fill(state);
+  }
+
+  std::string value;
+  uint64_t bits = 88172645463325252ULL + state.thread_index();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        cache->get(keys[next_random(bits) % keys.size()], value));
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    cache.reset();
+  }
+}
+BENCHMARK(BM_Get)
+    ->ArgsProduct({{1000, 100000, 1000000}, {16, 64, 256}})
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// Writes of 64-byte values over twice as many keys as fit, so half the
+// puts insert and evict. Arguments as for BM_Get; the write-behind queue
+// coalesces what reaches the stub storage.
+void BM_Put(benchmark::State &state) {
+  if (state.thread_index() == 0) {
+    fill(state);
+    for (size_t i = keys.size(), end = 2 * keys.size(); i < end; i++) {
+      keys.push_back(make_key(i, state.range(1)));
+    }
+  }
+
+  std::string value(64, 'v');
+  uint64_t bits = 88172645463325252ULL + state.thread_index();
+  for (auto _ : state) {
+    cache->put(keys[next_random(bits) % keys.size()], value);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  if (state.thread_index() == 0) {
+    cache.reset();
+  }
+}
+BENCHMARK(BM_Put)
+    ->ArgsProduct({{1000, 100000, 1000000}, {16, 64, 256}})
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+// Single-threaded hit latency as capacity grows; promotion is O(1), so
+// this should stay flat apart from CPU cache effects. Entries are loaded
+// into memory only, so large sizes don't write millions of rows.
+void BM_GetLatencyByCapacity(benchmark::State &state) {
+  size_t entries = state.range(0);
+  auto sized = make_cache(entries, Cache::DEFAULT_SHARDS);
+  std::vector<std::string> sized_keys;
+  sized_keys.reserve(entries);
+  for (size_t i = 0; i < entries; i++) {
+    sized_keys.push_back("key:" + std::to_string(i));
+    sized->load(sized_keys.back(), "value");
+  }
+
+  std::string value;
+  uint64_t bits = 88172645463325252ULL;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        sized->get(sized_keys[next_random(bits) % entries], value));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetLatencyByCapacity)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Arg(10000000)
+    ->Unit(benchmark::kNanosecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
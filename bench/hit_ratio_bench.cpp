@@ -0,0 +1,109 @@
+#include "../src/cache.hpp"
+#include "stub_storage.hpp"
+#include <algorithm>
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+// Replays synthetic key traces against a single-shard cache and reports
+// the hit ratio, comparing LRU with W-TinyLFU. Misses are filled with
+// load(), so the stub storage behind the cache is never read.
+
+namespace {
+
+const size_t CAPACITY = 1000;
+const size_t KEY_SPACE = 100000;
+const size_t TRACE_LENGTH = 500000;
+
+template <typename Policy>
+using Cache = LRUCache<std::string, std::string, std::hash<std::string>, Policy>;
+
+// Zipf(s = 0.99) over KEY_SPACE keys by inverse-CDF sampling.
+std::vector<size_t> zipf_trace(size_t length, uint32_t seed) {
+  std::vector<double> cdf(KEY_SPACE);
+  double sum = 0;
+  for (size_t i = 0; i < KEY_SPACE; i++) {
+    sum += 1.0 / std::pow(i + 1, 0.99);
+    cdf[i] = sum;
+  }
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> uniform(0, sum);
+  std::vector<size_t> trace(length);
+  for (auto &key : trace) {
+    key = std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin();
+  }
+  return trace;
+}
+
+// The Zipf trace interrupted every 50K requests by a sweep of 5K keys that
+// are never requested again, like an export or a crawler.
+std::vector<size_t> scan_trace(size_t length, uint32_t seed) {
+  std::vector<size_t> zipf = zipf_trace(length, seed);
+  std::vector<size_t> trace;
+  size_t next_scan_key = KEY_SPACE;
+  for (size_t i = 0; i < zipf.size(); i++) {
+    if (i % 50000 == 0) {
+      for (size_t j = 0; j < 5000; j++) {
+        trace.push_back(next_scan_key++);
+      }
+    }
+    trace.push_back(zipf[i]);
+  }
+  return trace;
+}
+
+template <typename Policy>
+void replay(benchmark::State &state, const std::vector<size_t> &trace) {
+  std::vector<std::string> names;
+  size_t max_key = *std::max_element(trace.begin(), trace.end());
+  for (size_t i = 0; i <= max_key; i++) {
+    names.push_back("key:" + std::to_string(i));
+  }
+
+  // One pass per run (see Iterations(1) below), so the cache is built
+  // outside the timed loop and starts cold.
+  Cache<Policy> cache(CAPACITY, std::chrono::seconds(3600), 1, 0,
+                      std::make_unique<StubStorage>());
+  uint64_t hits = 0, requests = 0;
+  std::string value;
+  for (auto _ : state) {
+    for (size_t key : trace) {
+      if (cache.lookup(names[key], value)) {
+        hits++;
+      } else {
+        cache.load(names[key], "value");
+      }
+    }
+    requests += trace.size();
+  }
+  state.counters["hit_ratio"] = static_cast<double>(hits) / requests;
+  state.SetItemsProcessed(requests);
+}
+
+void BM_ZipfLru(benchmark::State &state) {
+  static const auto trace = zipf_trace(TRACE_LENGTH, 1);
+  replay<LruPolicy<std::string>>(state, trace);
+}
+void BM_ZipfTinyLfu(benchmark::State &state) {
+  static const auto trace = zipf_trace(TRACE_LENGTH, 1);
+  replay<TinyLfuPolicy<std::string>>(state, trace);
+}
+void BM_ScanLru(benchmark::State &state) {
+  static const auto trace = scan_trace(TRACE_LENGTH, 2);
+  replay<LruPolicy<std::string>>(state, trace);
+}
+void BM_ScanTinyLfu(benchmark::State &state) {
+  static const auto trace = scan_trace(TRACE_LENGTH, 2);
+  replay<TinyLfuPolicy<std::string>>(state, trace);
+}
+
+BENCHMARK(BM_ZipfLru)->Unit(benchmark::kMillisecond)->Iterations(1);
+BENCHMARK(BM_ZipfTinyLfu)->Unit(benchmark::kMillisecond)->Iterations(1);
+BENCHMARK(BM_ScanLru)->Unit(benchmark::kMillisecond)->Iterations(1);
+BENCHMARK(BM_ScanTinyLfu)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+} // namespace
+
+BENCHMARK_MAIN();
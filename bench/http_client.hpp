@@ -0,0 +1,131 @@
+#ifndef HTTP_CLIENT_HPP
+#define HTTP_CLIENT_HPP
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdlib>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// Blocking client that reads whole replies off one connection.
+class Client {
+private:
+  int fd;
+  std::string buffer;
+  size_t offset = 0;
+  int status = 0;
+
+  bool fill() {
+    if (offset > 0 && offset == buffer.size()) {
+      buffer.clear();
+      offset = 0;
+    }
+    char chunk[16384];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+    return true;
+  }
+
+  // fill() may compact the buffer, so searches restart from `offset`.
+  size_t find_line() {
+    size_t end;
+    while ((end = buffer.find("\r\n", offset)) == std::string::npos) {
+      if (!fill())
+        return std::string::npos;
+    }
+    return end;
+  }
+
+  bool wait_for(size_t end) {
+    while (buffer.size() < end) {
+      if (!fill())
+        return false;
+    }
+    return true;
+  }
+
+public:
+  explicit Client(int port, const std::string &host = "127.0.0.1") {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    struct sockaddr_in address {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+      close(fd);
+      throw std::runtime_error("connect failed");
+    }
+  }
+  ~Client() { close(fd); }
+
+  Client(const Client &) = delete;
+  Client &operator=(const Client &) = delete;
+
+  // Gives up on reads after `timeout`, so a stalled server cannot hang the
+  // caller; the read then fails as if the connection had closed.
+  void set_read_timeout(std::chrono::milliseconds timeout) {
+    struct timeval tv {};
+    tv.tv_sec = timeout.count() / 1000;
+    tv.tv_usec = (timeout.count() % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+
+  // Status code of the last response read_http_response() read.
+  int last_status() const { return status; }
+
+  void send_all(const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t n = send(fd, data.data() + sent, data.size() - sent, 0);
+      if (n <= 0)
+        throw std::runtime_error("send failed");
+      sent += n;
+    }
+  }
+
+  bool read_http_response() {
+    size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n", offset)) == std::string::npos) {
+      if (!fill())
+        return false;
+    }
+    size_t length_at = buffer.find("Content-Length: ", offset);
+    size_t length = std::strtoul(buffer.c_str() + length_at + 16, nullptr, 10);
+    size_t end = head_end + 4 + length;
+    if (!wait_for(end))
+      return false;
+    status = std::atoi(buffer.c_str() + offset + 9); // "HTTP/1.1 200"
+    offset = end;
+    return true;
+  }
+
+  // Handles the simple, integer and bulk string replies GET/SET return.
+  bool read_resp_reply() {
+    size_t line_end = find_line();
+    if (line_end == std::string::npos)
+      return false;
+    size_t end = line_end + 2;
+    if (buffer[offset] == '$') {
+      long length = std::strtol(buffer.c_str() + offset + 1, nullptr, 10);
+      if (length >= 0) {
+        end += length + 2;
+      }
+    }
+    if (!wait_for(end))
+      return false;
+    offset = end;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "../src/http_parser.hpp"
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <string>
+
+namespace {
+
+const char GET_REQUEST[] = "GET /api/cached/user:123456 HTTP/1.1\r\n"
+                           "Host: localhost:8080\r\n"
+                           "User-Agent: curl/8.4.0\r\n"
+                           "Accept: */*\r\n\r\n";
+
+const char POST_REQUEST[] =
+    "POST /api/cached HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.4.0\r\n"
+    "Accept: */*\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 51\r\n\r\n"
+    "{\"key\":\"user:123456\",\"value\":\"John Doe\",\"ttl\":3600}";
+
+const char CHUNKED_REQUEST[] = "POST /api/echo HTTP/1.1\r\n"
+                               "Host: localhost:8080\r\n"
+                               "Transfer-Encoding: chunked\r\n\r\n"
+                               "10\r\n{\"test\":\"chunked\r\n"
+                               "3\r\n\"}\n\r\n"
+                               "0\r\n\r\n";
+
+// What handle_request used to do: copy the read buffer into a string and
+// probe it for each route in turn.
+void BM_LegacyFindRouting(benchmark::State &state) {
+  char buffer[1024] = {0};
+  memcpy(buffer, POST_REQUEST, sizeof(POST_REQUEST));
+  for (auto _ : state) {
+    std::string request(buffer);
+    bool routed = request.find("GET /api/export") != std::string::npos ||
+                  request.find("POST /api/cached") != std::string::npos;
+    size_t body_start = request.find("\r\n\r\n") + 4;
+    std::string body = request.substr(body_start);
+    benchmark::DoNotOptimize(routed);
+    benchmark::DoNotOptimize(body);
+  }
+}
+BENCHMARK(BM_LegacyFindRouting);
+
+void parse_loop(benchmark::State &state, const char *text, size_t length) {
+  std::string buffer(text, length);
+  std::string scratch = buffer;
+  HttpParser parser;
+  HttpRequest request;
+  for (auto _ : state) {
+    // Chunked bodies are decoded in place, so start each pass from a clean
+    // copy; assign() reuses the existing capacity.
+    scratch.assign(buffer);
+    parser.reset();
+    auto status = parser.parse(&scratch[0], scratch.size(), request);
+    benchmark::DoNotOptimize(status);
+    benchmark::DoNotOptimize(request.body.data());
+  }
+  state.SetBytesProcessed(state.iterations() * length);
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_ParseGet(benchmark::State &state) {
+  parse_loop(state, GET_REQUEST, sizeof(GET_REQUEST) - 1);
+}
+BENCHMARK(BM_ParseGet);
+
+void BM_ParsePost(benchmark::State &state) {
+  parse_loop(state, POST_REQUEST, sizeof(POST_REQUEST) - 1);
+}
+BENCHMARK(BM_ParsePost);
+
+void BM_ParseChunked(benchmark::State &state) {
+  parse_loop(state, CHUNKED_REQUEST, sizeof(CHUNKED_REQUEST) - 1);
+}
+BENCHMARK(BM_ParseChunked);
+
+// Parse cost when a request trickles in over `range(0)` reads.
+void BM_ParseIncremental(benchmark::State &state) {
+  std::string buffer(POST_REQUEST, sizeof(POST_REQUEST) - 1);
+  size_t step = buffer.size() / state.range(0) + 1;
+  HttpParser parser;
+  HttpRequest request;
+  for (auto _ : state) {
+    parser.reset();
+    HttpParser::Status status = HttpParser::Status::INCOMPLETE;
+    for (size_t end = step; status == HttpParser::Status::INCOMPLETE;
+         end += step) {
+      status = parser.parse(&buffer[0], std::min(end, buffer.size()), request);
+    }
+    benchmark::DoNotOptimize(status);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseIncremental)->Arg(1)->Arg(4)->Arg(16);
+
+} // namespace
+
+BENCHMARK_MAIN();
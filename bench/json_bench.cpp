@@ -0,0 +1,86 @@
+#include "../src/server.hpp"
+#include <benchmark/benchmark.h>
+#include <string>
+
+// The GET and POST /api/cached bodies built the way handle_request() does,
+// through a nlohmann::json DOM and an HttpResponse, against json_fast
+// writing into a reused output buffer. range(0) is the value size.
+
+namespace {
+
+std::string make_value(size_t size) {
+  std::string value(size, 'v');
+  for (size_t i = 7; i < size; i += 64) {
+    value[i] = '"'; // a few characters that need escaping
+  }
+  return value;
+}
+
+std::string make_body(const std::string &value) {
+  return json({{"key", "user:12345"}, {"value", value}, {"ttl", 3600}}).dump();
+}
+
+void BM_DomWriteGet(benchmark::State &state) {
+  std::string value = make_value(state.range(0));
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    json response = {
+        {"key", "user:12345"}, {"value", value}, {"status", "success"}};
+    HttpResponse(200, response.dump()).serialize(out, true);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * out.size());
+}
+
+void BM_FastWriteGet(benchmark::State &state) {
+  std::string value = make_value(state.range(0));
+  std::string out;
+  for (auto _ : state) {
+    out.clear();
+    HttpResponse::write_json(
+        out, 200,
+        {{"key", "user:12345"}, {"status", "success"}, {"value", value}},
+        true);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed(state.iterations() * out.size());
+}
+
+void BM_DomParsePost(benchmark::State &state) {
+  std::string body = make_body(make_value(state.range(0)));
+  for (auto _ : state) {
+    json request = json::parse(body.begin(), body.end());
+    std::string key = request["key"].get<std::string>();
+    std::string value = request["value"].get<std::string>();
+    int ttl = request.value("ttl", 300);
+    benchmark::DoNotOptimize(key.data());
+    benchmark::DoNotOptimize(value.data());
+    benchmark::DoNotOptimize(ttl);
+  }
+  state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+void BM_FastParsePost(benchmark::State &state) {
+  std::string body = make_body(make_value(state.range(0)));
+  json_fast::Parser parser;
+  json_fast::CacheEntryRequest entry;
+  std::string scratch;
+  for (auto _ : state) {
+    if (!parser.parse_entry(body, entry, scratch)) {
+      state.SkipWithError("body declined");
+      return;
+    }
+    benchmark::DoNotOptimize(entry.value.data());
+  }
+  state.SetBytesProcessed(state.iterations() * body.size());
+}
+
+} // namespace
+
+BENCHMARK(BM_DomWriteGet)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_FastWriteGet)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_DomParsePost)->Arg(16)->Arg(256)->Arg(4096);
+BENCHMARK(BM_FastParsePost)->Arg(16)->Arg(256)->Arg(4096);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,353 @@
+#include "../src/server.hpp"
+#include "http_client.hpp"
+#include "stub_storage.hpp"
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <limits>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// HTTP load generator for GET and POST /api/cached. Keys are drawn from a
+// Zipf distribution, and the run reports throughput and latency
+// percentiles.
+//
+//   closed loop: each connection sends its next request as soon as the
+//     previous response arrives, which measures peak throughput.
+//   open loop: requests go out on a fixed schedule (--rate in total)
+//     whether or not earlier ones were answered. Latency counts from when
+//     a request was due, so a server that falls behind is charged for the
+//     queueing it causes instead of slowing the generator down.
+//
+// Without --port it starts an HttpServer in process. A StubStorage seeded
+// with every key stands in for PostgreSQL, so misses pay --db-delay-us
+// and nothing external is needed.
+//
+//   ./load_gen --mode=open --rate=20000 --connections=32 --duration=10
+
+namespace {
+
+struct Options {
+  std::string mode = "closed";
+  std::string host = "127.0.0.1";
+  int port = 0;            // 0 serves from an in-process server
+  size_t connections = 16;
+  double duration = 10;    // seconds measured
+  double warmup = 2;       // seconds run before measuring
+  double rate = 10000;     // open loop: requests per second, all connections
+  size_t keys = 100000;
+  double zipf = 0.99;
+  double read_ratio = 0.9; // the rest are writes
+  size_t value_size = 64;
+  size_t capacity = 0;     // in-process cache entries; 0 is keys / 4
+  long db_delay_us = 200;  // in-process stub storage delay per call
+  uint32_t seed = 1;
+};
+
+bool parse(Options &options, int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+      return false;
+    }
+    std::string name = arg.substr(2, eq - 2);
+    const char *value = arg.c_str() + eq + 1;
+    if (name == "mode") {
+      options.mode = value;
+    } else if (name == "host") {
+      options.host = value;
+    } else if (name == "port") {
+      options.port = std::atoi(value);
+    } else if (name == "connections") {
+      options.connections = std::max(1L, std::strtol(value, nullptr, 10));
+    } else if (name == "duration") {
+      options.duration = std::atof(value);
+    } else if (name == "warmup") {
+      options.warmup = std::atof(value);
+    } else if (name == "rate") {
+      options.rate = std::atof(value);
+    } else if (name == "keys") {
+      options.keys = std::max(1L, std::strtol(value, nullptr, 10));
+    } else if (name == "zipf") {
+      options.zipf = std::atof(value);
+    } else if (name == "read-ratio") {
+      options.read_ratio = std::atof(value);
+    } else if (name == "value-size") {
+      options.value_size = std::strtoul(value, nullptr, 10);
+    } else if (name == "capacity") {
+      options.capacity = std::strtoul(value, nullptr, 10);
+    } else if (name == "db-delay-us") {
+      options.db_delay_us = std::strtol(value, nullptr, 10);
+    } else if (name == "seed") {
+      options.seed = std::strtoul(value, nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+  return (options.mode == "closed" || options.mode == "open") &&
+         options.rate > 0 && options.duration > 0;
+}
+
+// Zipf(s) over [0, n) by inverse-CDF sampling; rank 0 is the hottest key.
+class Zipf {
+private:
+  std::vector<double> cdf;
+
+public:
+  Zipf(size_t n, double s) : cdf(n) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      sum += 1.0 / std::pow(i + 1, s);
+      cdf[i] = sum;
+    }
+    for (double &p : cdf) {
+      p /= sum;
+    }
+  }
+
+  size_t operator()(std::mt19937_64 &rng) const {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    size_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    return std::min(rank, cdf.size() - 1);
+  }
+};
+
+std::string key_name(size_t rank) { return "load:" + std::to_string(rank); }
+
+// Builds requests for one connection from its own random stream.
+class Workload {
+private:
+  const Options &options;
+  const Zipf &zipf;
+  std::mt19937_64 rng;
+  std::string body;
+
+public:
+  Workload(const Options &options, const Zipf &zipf, uint64_t seed)
+      : options(options), zipf(zipf), rng(seed) {}
+
+  const std::string &next(std::string &request) {
+    std::string key = key_name(zipf(rng));
+    if (std::uniform_real_distribution<double>(0, 1)(rng) <
+        options.read_ratio) {
+      request = "GET /api/cached/" + key +
+                " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    } else {
+      body = "{\"key\":\"" + key + "\",\"value\":\"" +
+             std::string(options.value_size, 'v') + "\"}";
+      request = "POST /api/cached HTTP/1.1\r\nHost: localhost\r\n"
+                "Content-Type: application/json\r\nContent-Length: " +
+                std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+    return request;
+  }
+};
+
+using Clock = std::chrono::steady_clock;
+
+// What one connection saw during the measured window.
+struct Result {
+  std::vector<uint32_t> latencies_us;
+  size_t errors = 0;
+};
+
+void record(Result &result, Clock::time_point due, Clock::time_point measure,
+            int status, bool ok) {
+  if (due < measure) {
+    return;
+  }
+  if (!ok || status != 200) {
+    result.errors++;
+    if (!ok) {
+      return;
+    }
+  }
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - due)
+                .count();
+  result.latencies_us.push_back(static_cast<uint32_t>(
+      std::min<int64_t>(us, std::numeric_limits<uint32_t>::max())));
+}
+
+void closed_loop(const Options &options, Workload workload, Result &result,
+                 Clock::time_point measure, Clock::time_point end) {
+  Client client(options.port, options.host);
+  client.set_read_timeout(std::chrono::seconds(10));
+  std::string request;
+  while (Clock::now() < end) {
+    auto sent = Clock::now();
+    client.send_all(workload.next(request));
+    bool ok = client.read_http_response();
+    record(result, sent, measure, client.last_status(), ok);
+    if (!ok) {
+      return;
+    }
+  }
+}
+
+// A sender keeps the schedule while a receiver matches responses, which
+// arrive in request order, to the times their requests were due.
+// `index` staggers the connections' schedules across one interval.
+void open_loop(const Options &options, Workload workload, Result &result,
+               size_t index, Clock::time_point start,
+               Clock::time_point measure, Clock::time_point end) {
+  Client client(options.port, options.host);
+  client.set_read_timeout(std::chrono::seconds(10));
+  auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(options.connections / options.rate));
+  start += interval * index / options.connections;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Clock::time_point> due;
+  bool sending = true;
+
+  std::thread receiver([&]() {
+    while (true) {
+      Clock::time_point next;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return !due.empty() || !sending; });
+        if (due.empty()) {
+          return;
+        }
+        next = due.front();
+        due.pop_front();
+      }
+      bool ok = client.read_http_response();
+      record(result, next, measure, client.last_status(), ok);
+      if (!ok) {
+        return;
+      }
+    }
+  });
+
+  std::string request;
+  try {
+    for (auto next = start; next < end; next += interval) {
+      std::this_thread::sleep_until(next);
+      workload.next(request);
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        due.push_back(next);
+      }
+      cv.notify_one();
+      client.send_all(request);
+    }
+  } catch (const std::exception &) {
+    // The receiver sees the connection fail and records the errors.
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    sending = false;
+  }
+  cv.notify_one();
+  receiver.join();
+}
+
+double percentile(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(std::ceil(p * sorted.size())) - 1;
+  return sorted[std::min(index, sorted.size() - 1)] / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse(options, argc, argv)) {
+    std::fprintf(
+        stderr,
+        "usage: %s [--mode=closed|open] [--connections=N] [--duration=S]\n"
+        "          [--warmup=S] [--rate=QPS] [--keys=N] [--zipf=S]\n"
+        "          [--read-ratio=F] [--value-size=B] [--seed=N]\n"
+        "          [--host=IP --port=P | --capacity=N --db-delay-us=US]\n",
+        argv[0]);
+    return 2;
+  }
+
+  std::atomic<bool> stop_server{false};
+  std::thread server_thread;
+  if (options.port == 0) {
+    options.port = 18090;
+    auto storage = std::make_unique<StubStorage>(
+        std::chrono::microseconds(options.db_delay_us));
+    std::string value(options.value_size, 'v');
+    for (size_t i = 0; i < options.keys; i++) {
+      storage->seed(key_name(i), value);
+    }
+    ServerConfig config = ServerConfig::from_env();
+    config.cache_capacity =
+        options.capacity > 0 ? options.capacity : options.keys / 4;
+    config.max_requests_per_connection = SIZE_MAX;
+    server_thread = std::thread(
+        [&stop_server, config, port = options.port,
+         storage = std::move(storage)]() mutable {
+          HttpServer server(port, stop_server, config, std::move(storage));
+          server.start();
+        });
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+  }
+
+  Zipf zipf(options.keys, options.zipf);
+  std::vector<Result> results(options.connections);
+  std::vector<std::thread> workers;
+  auto start = Clock::now();
+  auto measure = start + std::chrono::duration_cast<Clock::duration>(
+                             std::chrono::duration<double>(options.warmup));
+  auto end = measure + std::chrono::duration_cast<Clock::duration>(
+                           std::chrono::duration<double>(options.duration));
+  for (size_t i = 0; i < options.connections; i++) {
+    workers.emplace_back([&, i]() {
+      Workload workload(options, zipf, options.seed * 1000003 + i);
+      try {
+        if (options.mode == "closed") {
+          closed_loop(options, std::move(workload), results[i], measure, end);
+        } else {
+          open_loop(options, std::move(workload), results[i], i, start,
+                    measure, end);
+        }
+      } catch (const std::exception &e) {
+        std::fprintf(stderr, "connection %zu: %s\n", i, e.what());
+        results[i].errors++;
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  std::vector<uint32_t> latencies;
+  size_t errors = 0;
+  for (auto &result : results) {
+    latencies.insert(latencies.end(), result.latencies_us.begin(),
+                     result.latencies_us.end());
+    errors += result.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  std::printf("mode=%s connections=%zu keys=%zu zipf=%.2f read_ratio=%.2f",
+              options.mode.c_str(), options.connections, options.keys,
+              options.zipf, options.read_ratio);
+  if (options.mode == "open") {
+    std::printf(" target_qps=%.0f", options.rate);
+  }
+  std::printf("\nrequests=%zu errors=%zu qps=%.0f\n", latencies.size(), errors,
+              latencies.size() / options.duration);
+  std::printf("latency_ms p50=%.3f p99=%.3f p999=%.3f max=%.3f\n",
+              percentile(latencies, 0.5), percentile(latencies, 0.99),
+              percentile(latencies, 0.999), percentile(latencies, 1.0));
+
+  if (server_thread.joinable()) {
+    stop_server = true;
+    server_thread.join();
+  }
+  return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,73 @@
+#include "../src/latency.hpp"
+#include "../src/striped_counter.hpp"
+#include <prometheus/counter.h>
+#include <prometheus/histogram.h>
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <chrono>
+
+// Cost of recording one metric update from 1 to 32 threads, all updating
+// the same metric as every request does: prometheus-cpp's Counter and
+// Histogram, a bare shared atomic (the floor for any single-cell counter),
+// and the striped versions the cache records into.
+
+namespace {
+
+prometheus::Counter prometheus_counter;
+std::atomic<uint64_t> shared_counter{0};
+StripedCounter striped_counter;
+prometheus::Histogram prometheus_histogram(
+    prometheus::Histogram::BucketBoundaries{0.0001, 0.001, 0.01, 0.1, 1.0});
+LatencyHistogram latency_histogram({0.0001, 0.001, 0.01, 0.1, 1.0});
+
+void BM_PrometheusCounter(benchmark::State &state) {
+  for (auto _ : state) {
+    prometheus_counter.Increment();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PrometheusCounter)->ThreadRange(1, 32)->UseRealTime();
+
+void BM_SharedAtomic(benchmark::State &state) {
+  for (auto _ : state) {
+    shared_counter.fetch_add(1, std::memory_order_relaxed);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SharedAtomic)->ThreadRange(1, 32)->UseRealTime();
+
+void BM_StripedCounter(benchmark::State &state) {
+  for (auto _ : state) {
+    striped_counter.increment();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StripedCounter)->ThreadRange(1, 32)->UseRealTime();
+
+// What a scrape pays to read a striped counter.
+void BM_StripedCounterRead(benchmark::State &state) {
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(striped_counter.value());
+  }
+}
+BENCHMARK(BM_StripedCounterRead);
+
+void BM_PrometheusHistogram(benchmark::State &state) {
+  for (auto _ : state) {
+    prometheus_histogram.Observe(0.0005);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PrometheusHistogram)->ThreadRange(1, 32)->UseRealTime();
+
+void BM_LatencyHistogram(benchmark::State &state) {
+  for (auto _ : state) {
+    latency_histogram.observe(std::chrono::microseconds(500));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LatencyHistogram)->ThreadRange(1, 32)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
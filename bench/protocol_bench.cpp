@@ -0,0 +1,129 @@
+#include "../src/server.hpp"
+#include "http_client.hpp"
+#include "stub_storage.hpp"
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Round trips against an in-process server: the same GET and SET through
+// the HTTP/JSON endpoints and through the RESP listener, with a
+// StubStorage in place of PostgreSQL. range(0) is the pipeline depth.
+
+namespace {
+
+const int HTTP_PORT = 18080;
+const int RESP_PORT = 16379;
+const std::string VALUE(64, 'v');
+
+std::atomic<bool> stop_server{false};
+std::unique_ptr<std::thread> server_thread;
+std::once_flag server_started;
+
+void start_server() {
+  ServerConfig config = ServerConfig::from_env();
+  config.resp_port = RESP_PORT;
+  config.max_requests_per_connection = SIZE_MAX;
+  server_thread = std::make_unique<std::thread>([config]() {
+    HttpServer server(HTTP_PORT, stop_server, config,
+                      std::make_unique<StubStorage>());
+    server.start();
+  });
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+}
+
+std::string http_get(const std::string &key) {
+  return "GET /api/cached/" + key + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+}
+
+std::string http_set(const std::string &key) {
+  std::string body = json({{"key", key}, {"value", VALUE}, {"ttl", 3600}}).dump();
+  return "POST /api/cached HTTP/1.1\r\nHost: localhost\r\n"
+         "Content-Type: application/json\r\nContent-Length: " +
+         std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+std::string resp_get(const std::string &key) {
+  std::string out;
+  resp::array(out, 2);
+  resp::bulk(out, "GET");
+  resp::bulk(out, key);
+  return out;
+}
+
+std::string resp_set(const std::string &key) {
+  std::string out;
+  resp::array(out, 5);
+  resp::bulk(out, "SET");
+  resp::bulk(out, key);
+  resp::bulk(out, VALUE);
+  resp::bulk(out, "EX");
+  resp::bulk(out, "3600");
+  return out;
+}
+
+using Build = std::string (*)(const std::string &);
+
+// Sends range(0) requests per iteration and waits for all the replies.
+// `prime`, if given, is sent once beforehand so GETs hit memory.
+template <typename Read>
+void round_trips(benchmark::State &state, int port, Build build, Read read,
+                 Build prime = nullptr) {
+  std::call_once(server_started, start_server);
+  Client client(port);
+  size_t depth = state.range(0);
+  std::string key = "bench:" + std::to_string(state.thread_index());
+  if (prime) {
+    client.send_all(prime(key));
+    (client.*read)();
+  }
+  std::string batch;
+  for (size_t i = 0; i < depth; i++) {
+    batch += build(key);
+  }
+  for (auto _ : state) {
+    client.send_all(batch);
+    for (size_t i = 0; i < depth; i++) {
+      if (!(client.*read)()) {
+        state.SkipWithError("connection closed");
+        return;
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * depth);
+}
+
+void BM_HttpJsonGet(benchmark::State &state) {
+  round_trips(state, HTTP_PORT, http_get, &Client::read_http_response,
+              http_set);
+}
+
+void BM_RespGet(benchmark::State &state) {
+  round_trips(state, RESP_PORT, resp_get, &Client::read_resp_reply, resp_set);
+}
+
+void BM_HttpJsonSet(benchmark::State &state) {
+  round_trips(state, HTTP_PORT, http_set, &Client::read_http_response);
+}
+
+void BM_RespSet(benchmark::State &state) {
+  round_trips(state, RESP_PORT, resp_set, &Client::read_resp_reply);
+}
+
+} // namespace
+
+BENCHMARK(BM_HttpJsonGet)->Arg(1)->Arg(16)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_RespGet)->Arg(1)->Arg(16)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_HttpJsonSet)->Arg(1)->Arg(16)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_RespSet)->Arg(1)->Arg(16)->ThreadRange(1, 8)->UseRealTime();
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  stop_server = true;
+  if (server_thread) {
+    server_thread->join();
+  }
+  return 0;
+}
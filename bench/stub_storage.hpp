@@ -0,0 +1,105 @@
+#ifndef STUB_STORAGE_HPP
+#define STUB_STORAGE_HPP
+
+#include "../src/storage.hpp"
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Stands in for PostgreSQL so the benchmarks run without external
+// services: an in-memory table behind a fixed delay per call, standing in
+// for the network round trip and query. Pass a zero delay to measure the
+// cache alone.
+class StubStorage : public Storage {
+private:
+  struct Row {
+    std::string value;
+    std::chrono::system_clock::time_point expiry;
+  };
+
+  std::chrono::microseconds delay;
+  std::mutex mutex;
+  std::unordered_map<std::string, Row> rows;
+
+  void round_trip() const {
+    if (delay.count() > 0) {
+      std::this_thread::sleep_for(delay);
+    }
+  }
+
+public:
+  explicit StubStorage(
+      std::chrono::microseconds delay = std::chrono::microseconds(0))
+      : delay(delay) {}
+
+  // Adds a row without paying the delay, to seed a benchmark's data set.
+  void seed(const std::string &key, const std::string &value,
+            std::chrono::seconds ttl = std::chrono::hours(24)) {
+    std::lock_guard<std::mutex> lock(mutex);
+    rows[key] = {value, std::chrono::system_clock::now() + ttl};
+  }
+
+  bool put(const std::string &key, const std::string &value,
+           const std::chrono::system_clock::time_point &expiry) override {
+    round_trip();
+    std::lock_guard<std::mutex> lock(mutex);
+    rows[key] = {value, expiry};
+    return true;
+  }
+
+  bool put_many(const std::vector<CacheRow> &batch) override {
+    round_trip();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &row : batch) {
+      if (row.deleted) {
+        rows.erase(row.key);
+      } else {
+        rows[row.key] = {row.value, row.expiry};
+      }
+    }
+    return true;
+  }
+
+  std::optional<std::string>
+  get(const std::string &key, std::chrono::seconds *remaining_ttl = nullptr,
+      bool * = nullptr) override {
+    round_trip();
+    auto now = std::chrono::system_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = rows.find(key);
+    if (it == rows.end() || it->second.expiry <= now) {
+      return std::nullopt;
+    }
+    if (remaining_ttl) {
+      *remaining_ttl =
+          std::chrono::ceil<std::chrono::seconds>(it->second.expiry - now);
+    }
+    return it->second.value;
+  }
+
+  std::vector<CacheRow> get_many(const std::vector<std::string> &keys,
+                                 bool * = nullptr) override {
+    round_trip();
+    auto now = std::chrono::system_clock::now();
+    std::vector<CacheRow> found;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &key : keys) {
+      auto it = rows.find(key);
+      if (it != rows.end() && it->second.expiry > now) {
+        found.push_back({key, it->second.value, it->second.expiry});
+      }
+    }
+    return found;
+  }
+
+  void cleanup_expired() override {
+    auto now = std::chrono::system_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = rows.begin(); it != rows.end();) {
+      it = it->second.expiry <= now ? rows.erase(it) : std::next(it);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef BUFFER_POOL_HPP
+#define BUFFER_POOL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Growable byte buffer with a readable region [begin, end) and spare room
+// after it. Sockets read straight into the spare room, and consumed bytes
+// are reclaimed by compacting instead of reallocating.
+class IoBuffer {
+private:
+  std::unique_ptr<char[]> storage;
+  size_t capacity_ = 0;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+
+public:
+  IoBuffer() = default;
+  explicit IoBuffer(size_t capacity)
+      : storage(new char[capacity]), capacity_(capacity) {}
+
+  IoBuffer(IoBuffer &&) = default;
+  IoBuffer &operator=(IoBuffer &&) = default;
+
+  char *data() { return storage.get() + begin_; }
+  const char *data() const { return storage.get() + begin_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+  size_t capacity() const { return capacity_; }
+  size_t writable() const { return capacity_ - end_; }
+
+  // Makes room for at least `n` more bytes and returns where they go.
+  // Existing bytes may move, so offsets relative to data() stay valid but
+  // raw pointers do not.
+  char *prepare(size_t n) {
+    if (writable() >= n) {
+      return storage.get() + end_;
+    }
+    size_t used = size();
+    if (capacity_ >= used + n && begin_ > 0) {
+      memmove(storage.get(), data(), used);
+    } else {
+      size_t grown = std::max(capacity_ * 2, used + n);
+      std::unique_ptr<char[]> larger(new char[grown]);
+      if (used > 0) {
+        memcpy(larger.get(), data(), used);
+      }
+      storage = std::move(larger);
+      capacity_ = grown;
+    }
+    begin_ = 0;
+    end_ = used;
+    return storage.get() + end_;
+  }
+
+  void commit(size_t n) { end_ += n; }
+
+  void consume(size_t n) {
+    begin_ += n;
+    if (begin_ >= end_) {
+      begin_ = end_ = 0;
+    }
+  }
+
+  void clear() { begin_ = end_ = 0; }
+};
+
+// Free list of read buffers owned by one event loop, so connections reuse
+// storage that earlier connections already grew instead of allocating anew.
+// Not thread-safe; each loop keeps its own.
+class BufferPool {
+private:
+  std::vector<IoBuffer> free_buffers;
+  size_t initial_capacity;
+  size_t max_pooled;
+  size_t max_retained_capacity;
+
+public:
+  BufferPool(size_t initial_capacity, size_t max_pooled,
+             size_t max_retained_capacity)
+      : initial_capacity(initial_capacity), max_pooled(max_pooled),
+        max_retained_capacity(max_retained_capacity) {}
+
+  IoBuffer acquire() {
+    if (free_buffers.empty()) {
+      return IoBuffer(initial_capacity);
+    }
+    IoBuffer buffer = std::move(free_buffers.back());
+    free_buffers.pop_back();
+    return buffer;
+  }
+
+  // Oversized buffers are dropped so one huge request does not pin its
+  // memory for the lifetime of the loop.
+  void release(IoBuffer &&buffer) {
+    if (free_buffers.size() >= max_pooled ||
+        buffer.capacity() > max_retained_capacity || buffer.capacity() == 0) {
+      return;
+    }
+    buffer.clear();
+    free_buffers.push_back(std::move(buffer));
+  }
+
+  size_t pooled() const { return free_buffers.size(); }
+};
+
+#endif
@@ -2,144 +2,982 @@
 #define CACHE_HPP
 
 #include "database.hpp"
+#include "eviction.hpp"
+#include "local_store.hpp"
 #include "metrics.hpp"
+#include "negative_cache.hpp"
+#include "refresh.hpp"
+#include "storage.hpp"
+#include "timer_wheel.hpp"
+#include "write_behind.hpp"
 #include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <list>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
+
+// Heap bytes a key or value owns beyond its inline object, for byte-budget
+// accounting. Overload for other types that own dynamic storage.
+template <typename T> size_t cache_payload_bytes(const T &) { return 0; }
+inline size_t cache_payload_bytes(const std::string &s) { return s.size(); }
+
+// Sharded in-memory cache in front of a Storage backend: PostgreSQL, or a
+// LocalStore when CACHE_STORAGE=local. Eviction order is set by
+// `Policy` (see eviction.hpp): LRU by default, or TinyLfuPolicy<K> for
+// scan-resistant admission.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename Policy = LruPolicy<K>>
+class LRUCache {
+public:
+  struct ShardStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t size;
+    size_t capacity;
+    size_t bytes;
+
+    double hit_rate() const {
+      uint64_t total = hits + misses;
+      return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+    }
+  };
+
+  static const size_t DEFAULT_SHARDS = 16;
+  // Shards never get fewer slots than this, so small caches stay exact LRU.
+  static const size_t MIN_SHARD_CAPACITY = 64;
+  // Likewise for byte budgets.
+  static const size_t MIN_SHARD_BYTES = 64 * 1024;
+  // Most timers fired or cascaded per shard lock hold while expiring.
+  static const size_t EXPIRY_BATCH = 256;
+
+  // One write in a put_many() batch; a zero ttl means the default.
+  struct Entry {
+    K key;
+    V value;
+    std::chrono::seconds ttl{0};
+  };
 
-template <typename K, typename V> class LRUCache {
 private:
   struct CacheEntry {
     V value;
     std::chrono::steady_clock::time_point expiry;
-    CacheEntry(V v, std::chrono::seconds ttl)
-        : value(v), expiry(std::chrono::steady_clock::now() + ttl) {}
+    typename Policy::Handle handle;
+    typename TimerWheel<const K *>::Handle timer;
+    size_t bytes; // charged against the shard's byte budget
+    // A read from then on queues a background reload; max() once queued,
+    // or when refreshing is off.
+    std::chrono::steady_clock::time_point refresh_at =
+        std::chrono::steady_clock::time_point::max();
+    CacheEntry(V v, std::chrono::seconds ttl, size_t bytes)
+        : value(v), expiry(std::chrono::steady_clock::now() + ttl),
+          bytes(bytes) {}
+  };
+
+  using CacheMap = std::unordered_map<K, CacheEntry, Hash>;
+
+  // A database load in progress for one key. Later misses for the key wait
+  // for it instead of issuing their own query.
+  struct Flight {
+    std::condition_variable_any done_cv;
+    bool done = false;
+    // Set when the key is written while loading, so the loaded value is
+    // stale and must not overwrite the newer one.
+    bool superseded = false;
+    bool found = false;
+    V value;
+  };
+
+public:
+  // Fixed cost of one entry on top of its key and value payloads: the map
+  // node (key and entry plus next pointer and cached hash), a bucket slot,
+  // roughly three pointers for the eviction policy's list node and five for
+  // the timer wheel's. Allocator headers are not counted.
+  static const size_t ENTRY_OVERHEAD =
+      sizeof(typename CacheMap::value_type) + 11 * sizeof(void *);
+
+private:
+  // An independent cache over a slice of the key space and of the capacity.
+  // Map keys have stable addresses, so the policy and the timer wheel track
+  // them by pointer.
+  struct Shard {
+    TimedMutex mutex;
+    CacheMap cache_map;
+    Policy policy;
+    TimerWheel<const K *> timers;
+    std::unordered_map<K, std::shared_ptr<Flight>, Hash> loading;
+    NegativeCache<K, Hash> absent; // keys the database lacked
+    size_t capacity;
+    size_t max_bytes;
+    size_t bytes = 0;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    Shard(size_t capacity, size_t max_bytes, size_t max_absent,
+          std::chrono::milliseconds absent_ttl)
+        : policy(std::min({capacity, max_bytes / ENTRY_OVERHEAD,
+                           size_t(1) << 20})),
+          absent(max_absent, absent_ttl), capacity(capacity),
+          max_bytes(max_bytes) {}
   };
 
+  // Timer wheel resolution and how often the expiry thread advances it.
+  static constexpr std::chrono::milliseconds TIMER_TICK{100};
+  static constexpr std::chrono::minutes DB_CLEANUP_INTERVAL{5};
+
+  const std::chrono::steady_clock::time_point epoch =
+      std::chrono::steady_clock::now();
   size_t capacity;
-  std::mutex cache_mutex;
-  std::unordered_map<K, CacheEntry> cache_map;
-  std::list<K> lru_list;
+  size_t max_bytes;
+  std::vector<std::unique_ptr<Shard>> shards;
+  std::atomic<size_t> entry_count{0};
+  std::atomic<size_t> memory_bytes{0};
+  Hash hasher;
   std::chrono::seconds default_ttl;
   std::unique_ptr<CacheMetrics> metrics;
-  std::unique_ptr<DatabaseConnection> db;
+  std::unique_ptr<Storage> storage;
+  DatabaseConnection *db; // the storage, when it is PostgreSQL
+  // Declared after storage and metrics so it drains before they are
+  // destroyed. Null when the storage keeps nothing.
+  std::unique_ptr<WriteBehindQueue> writes;
+  RefreshConfig refresh_config;
+  // Null unless refresh-ahead or stale serving is on. Declared after the
+  // shards and storage so its workers stop before those are destroyed.
+  std::unique_ptr<RefreshQueue<K>> refreshes;
   std::atomic<bool> cleanup_running;
+  std::mutex cleanup_mutex;
+  std::condition_variable cleanup_cv;
   std::unique_ptr<std::thread> cleanup_thread;
+  // Purges expired rows from persistent storage, apart from cleanup_thread
+  // so a slow purge never delays expiry.
+  std::unique_ptr<std::thread> storage_cleanup_thread;
+
+  size_t shard_index(uint64_t hash) const {
+    // Mix the hash so shard selection does not reuse the low bits the
+    // shard's own unordered_map buckets on.
+    uint64_t h = hash * 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(h >> 32) % shards.size();
+  }
+
+  // Shard i's part of `limit`, spreading the remainder so the parts add up
+  // to the whole; an unset (0) limit is unbounded in every shard.
+  static size_t slice(size_t limit, size_t i, size_t shard_count) {
+    if (limit == 0) {
+      return std::numeric_limits<size_t>::max();
+    }
+    return limit / shard_count + (i < limit % shard_count);
+  }
+
+  // Wheel tick of `time`. Expiries round up and the current time rounds
+  // down, so a timer never fires before its entry has expired.
+  uint64_t tick_of(std::chrono::steady_clock::time_point time,
+                   bool round_up) const {
+    auto since = time - epoch;
+    if (since <= since.zero()) {
+      return 0;
+    }
+    int64_t tick = TIMER_TICK.count();
+    if (round_up) {
+      return (std::chrono::ceil<std::chrono::milliseconds>(since).count() +
+              tick - 1) /
+             tick;
+    }
+    return std::chrono::floor<std::chrono::milliseconds>(since).count() / tick;
+  }
+
+  // Wheel tick at which the entry leaves memory: its expiry, plus the
+  // window in which it may still be served stale.
+  uint64_t expiry_tick(const CacheEntry &entry) const {
+    return tick_of(entry.expiry + refresh_config.stale, true);
+  }
+
+  // When reads of an entry stored for `ttl` start its reload: the last
+  // `ahead` fraction of the TTL, or at expiry when only stale serving is
+  // on.
+  std::chrono::steady_clock::time_point
+  refresh_time(const CacheEntry &entry, std::chrono::seconds ttl) const {
+    if (!refreshes) {
+      return std::chrono::steady_clock::time_point::max();
+    }
+    return entry.expiry -
+           std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+               ttl * refresh_config.ahead);
+  }
+
+  // Whether a key storage did not return may be remembered as absent; see
+  // WriteBehindQueue::settled(). `flushes` is read before the query.
+  bool settled(const K &key, uint64_t flushes) {
+    return !writes || writes->settled(key, flushes);
+  }
+
+  static bool over_budget(const Shard &shard) {
+    return shard.cache_map.size() > shard.capacity ||
+           shard.bytes > shard.max_bytes;
+  }
+
+  // `timer_fired` is set when the wheel has already dropped the timer.
+  void erase(Shard &shard, typename CacheMap::iterator it,
+             bool timer_fired = false) {
+    shard.bytes -= it->second.bytes;
+    memory_bytes -= it->second.bytes;
+    --entry_count;
+    shard.policy.remove(it->second.handle);
+    if (!timer_fired) {
+      shard.timers.cancel(it->second.timer);
+    }
+    shard.cache_map.erase(it);
+  }
 
-  void evict() {
-    if (!lru_list.empty()) {
-      auto last = lru_list.back();
-      lru_list.pop_back();
-      cache_map.erase(last);
+  // Drops the shard's expired entries a batch at a time, releasing the
+  // lock between batches so requests can interleave.
+  size_t expire(Shard &shard, uint64_t now) {
+    size_t expired = 0;
+    bool done = false;
+    while (!done) {
+      std::lock_guard<TimedMutex> lock(shard.mutex);
+      done = shard.timers.advance(now, EXPIRY_BATCH, [&](const K *key) {
+        erase(shard, shard.cache_map.find(*key), true);
+        expired++;
+      });
+    }
+    return expired;
+  }
+
+  void evict(Shard &shard) {
+    if (const K *victim = shard.policy.victim()) {
+      erase(shard, shard.cache_map.find(*victim));
       metrics->record_eviction();
-      metrics->update_size(cache_map.size());
     }
   }
 
+  // Inserts or overwrites the in-memory entry, then evicts the policy's
+  // victims until the shard is back within its entry and byte limits; an
+  // admission policy may pick the new entry itself. A value too large for
+  // the shard's whole budget is left to the database.
+  void store(const K &key, const V &value, std::chrono::seconds ttl) {
+    uint64_t hash = hasher(key);
+    Shard &shard = *shards[shard_index(hash)];
+    std::lock_guard<TimedMutex> lock(shard.mutex);
+    store_locked(shard, key, hash, value, ttl);
+  }
+
+  // store() with the shard's lock already held.
+  void store_locked(Shard &shard, const K &key, uint64_t hash, const V &value,
+                    std::chrono::seconds ttl) {
+    auto flight = shard.loading.find(key);
+    if (flight != shard.loading.end()) {
+      flight->second->superseded = true;
+    }
+    shard.absent.erase(key);
+    size_t bytes =
+        ENTRY_OVERHEAD + cache_payload_bytes(key) + cache_payload_bytes(value);
+    auto it = shard.cache_map.find(key);
+    if (it != shard.cache_map.end()) {
+      if (bytes > shard.max_bytes) {
+        erase(shard, it);
+        return;
+      }
+      CacheEntry &entry = it->second;
+      shard.bytes += bytes - entry.bytes;
+      memory_bytes += bytes - entry.bytes;
+      entry.bytes = bytes;
+      entry.value = value;
+      entry.expiry = std::chrono::steady_clock::now() + ttl;
+      entry.refresh_at = refresh_time(entry, ttl);
+      shard.policy.access(entry.handle, hash);
+      shard.timers.reschedule(entry.timer, expiry_tick(entry));
+    } else {
+      if (bytes > shard.max_bytes) {
+        return;
+      }
+      it = shard.cache_map.emplace(key, CacheEntry(value, ttl, bytes)).first;
+      it->second.handle = shard.policy.admit(&it->first, hash);
+      it->second.timer =
+          shard.timers.schedule(&it->first, expiry_tick(it->second));
+      it->second.refresh_at = refresh_time(it->second, ttl);
+      shard.bytes += bytes;
+      memory_bytes += bytes;
+      ++entry_count;
+    }
+
+    while (over_budget(shard)) {
+      evict(shard);
+    }
+  }
+
+  // Stores a batch in memory, taking each shard's lock once. A key
+  // repeated in the batch keeps its last value; returns the index of each
+  // entry kept.
+  std::vector<size_t> store_many(const std::vector<Entry> &entries) {
+    std::unordered_map<K, size_t, Hash> last;
+    for (size_t i = 0; i < entries.size(); i++) {
+      last[entries[i].key] = i;
+    }
+    std::vector<size_t> unique;
+    std::vector<uint64_t> hashes;
+    for (size_t i = 0; i < entries.size(); i++) {
+      if (last[entries[i].key] == i) {
+        unique.push_back(i);
+        hashes.push_back(hasher(entries[i].key));
+      }
+    }
+
+    auto groups = group_by_shard(hashes);
+    for (size_t s = 0; s < shards.size(); s++) {
+      if (groups[s].empty()) {
+        continue;
+      }
+      std::lock_guard<TimedMutex> lock(shards[s]->mutex);
+      for (size_t j : groups[s]) {
+        const Entry &entry = entries[unique[j]];
+        store_locked(*shards[s], entry.key, hashes[j], entry.value,
+                     entry.ttl.count() == 0 ? default_ttl : entry.ttl);
+      }
+    }
+    return unique;
+  }
+
+  static std::unique_ptr<Storage> open_storage(const StorageConfig &config) {
+    if (config.backend == StorageBackend::LOCAL) {
+      return std::make_unique<LocalStore>();
+    }
+    if (config.backend == StorageBackend::NONE) {
+      return std::make_unique<NullStorage>();
+    }
+    return std::make_unique<DatabaseConnection>();
+  }
+
+  // Hit path shared by lookup() and get(). Records the shard's hit or miss
+  // and the global hit; the caller records the global miss.
+  bool find_in_memory(const K &key, V &value, bool *stale = nullptr) {
+    uint64_t hash = hasher(key);
+    Shard &shard = *shards[shard_index(hash)];
+    std::lock_guard<TimedMutex> lock(shard.mutex);
+    return find_locked(shard, key, hash, value, stale);
+  }
+
+  // find_in_memory() with the shard's lock already held. An entry expired
+  // less than CACHE_SERVE_STALE_SECS ago is only a hit when `stale` is
+  // given, and sets it; otherwise it is a miss, left in place for the
+  // reload to replace. A hit past the entry's refresh_at queues its reload.
+  bool find_locked(Shard &shard, const K &key, uint64_t hash, V &value,
+                   bool *stale = nullptr) {
+    auto it = shard.cache_map.find(key);
+    if (it != shard.cache_map.end()) {
+      CacheEntry &entry = it->second;
+      auto now = std::chrono::steady_clock::now();
+      bool fresh = now <= entry.expiry;
+      bool servable = now <= entry.expiry + refresh_config.stale;
+      if (fresh || (stale && servable)) {
+        shard.hits.fetch_add(1, std::memory_order_relaxed);
+        metrics->record_hit();
+        value = entry.value;
+        shard.policy.access(entry.handle, hash);
+        if (refreshes && now >= entry.refresh_at) {
+          if (refreshes->submit(key)) {
+            entry.refresh_at = std::chrono::steady_clock::time_point::max();
+            metrics->record_refresh();
+          } else {
+            entry.refresh_at = now + TIMER_TICK; // queue full; retry soon
+          }
+        }
+        if (!fresh) {
+          *stale = true;
+          metrics->record_stale_served();
+        }
+        return true;
+      }
+      if (!servable) {
+        erase(shard, it);
+        metrics->record_expired();
+      }
+    }
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Indexes into `hashes` grouped by shard, so a batch takes each shard's
+  // lock once.
+  std::vector<std::vector<size_t>>
+  group_by_shard(const std::vector<uint64_t> &hashes) const {
+    std::vector<std::vector<size_t>> groups(shards.size());
+    for (size_t i = 0; i < hashes.size(); i++) {
+      groups[shard_index(hashes[i])].push_back(i);
+    }
+    return groups;
+  }
+
+  // Makes one storage call, recording how long it took.
+  template <typename Call>
+  auto timed(CacheMetrics::DbQuery query, Call &&call) {
+    auto start = std::chrono::steady_clock::now();
+    auto result = call();
+    metrics->observe_db_query(query, std::chrono::steady_clock::now() - start);
+    return result;
+  }
+
+  // Joins the key's in-flight database load, or starts one and publishes
+  // its result to everyone who joined. A miss while the storage is not
+  // ready yet is not looked up. A `refresh` reloads an entry in the
+  // background instead, and leaves a key already being loaded alone.
+  bool load_through(const K &key, V &value, bool refresh = false) {
+    if (!storage->ready()) {
+      return false;
+    }
+    uint64_t hash = hasher(key);
+    Shard &shard = *shards[shard_index(hash)];
+    std::unique_lock<TimedMutex> lock(shard.mutex);
+    if (shard.absent.contains(key, std::chrono::steady_clock::now())) {
+      metrics->record_db_lookup_avoided();
+      return false;
+    }
+
+    auto [slot, leader] = shard.loading.try_emplace(key);
+    if (!leader && refresh) {
+      return false;
+    }
+    if (!leader) {
+      std::shared_ptr<Flight> flight = slot->second;
+      metrics->record_read_coalesced();
+      flight->done_cv.wait(lock, [&]() { return flight->done; });
+      if (flight->found) {
+        value = flight->value;
+      }
+      return flight->found;
+    }
+    auto flight = std::make_shared<Flight>();
+    slot->second = flight;
+    lock.unlock();
+
+    std::chrono::seconds ttl = default_ttl;
+    uint64_t flushes = writes ? writes->flushes() : 0;
+    bool failed = false;
+    auto db_value = timed(CacheMetrics::DbQuery::GET,
+                          [&]() { return storage->get(key, &ttl, &failed); });
+
+    lock.lock();
+    shard.loading.erase(key);
+    if (flight->superseded) {
+      // A put() landed meanwhile; hand out its value instead.
+      auto it = shard.cache_map.find(key);
+      flight->found = it != shard.cache_map.end();
+      if (flight->found) {
+        flight->value = it->second.value;
+      }
+    } else if (db_value) {
+      flight->found = true;
+      flight->value = *db_value;
+      auto it = shard.cache_map.find(key);
+      auto before = it != shard.cache_map.end()
+                        ? it->second.expiry
+                        : std::chrono::steady_clock::time_point::min();
+      store_locked(shard, key, hash, flight->value, ttl);
+      // A row expiring no later than the entry it reloaded (TTLs round up
+      // to whole seconds) would only be reloaded again on the next read;
+      // reload it once more when it expires, through the stale path, which
+      // drops it once the database has expired it too.
+      it = shard.cache_map.find(key);
+      if (refreshes && it != shard.cache_map.end() &&
+          it->second.expiry <= before + std::chrono::seconds(1)) {
+        it->second.refresh_at = it->second.expiry;
+      }
+    } else {
+      // An entry still live in memory is kept until it expires: its write
+      // may not have reached the database yet, or the query failed. Only a
+      // confirmed miss is remembered as absent.
+      auto it = shard.cache_map.find(key);
+      auto now = std::chrono::steady_clock::now();
+      if (it == shard.cache_map.end() || now > it->second.expiry) {
+        if (it != shard.cache_map.end()) {
+          erase(shard, it);
+        }
+        if (!failed && settled(key, flushes)) {
+          shard.absent.insert(key, now);
+        }
+      }
+    }
+    flight->done = true;
+    flight->done_cv.notify_all();
+    if (flight->found) {
+      value = flight->value;
+    }
+    return flight->found;
+  }
+
 public:
+  // `size` caps the number of entries and `max_bytes` the bytes they are
+  // charged (key + value + ENTRY_OVERHEAD); 0 disables either limit.
+  // Without `backend`, the storage is chosen by StorageConfig::from_env().
   LRUCache(size_t size = 1024,
-           std::chrono::seconds ttl = std::chrono::seconds(300))
-      : capacity(size), default_ttl(ttl),
+           std::chrono::seconds ttl = std::chrono::seconds(300),
+           size_t shard_count = DEFAULT_SHARDS, size_t max_bytes = 0,
+           std::unique_ptr<Storage> backend = nullptr)
+      : capacity(size), max_bytes(max_bytes), default_ttl(ttl),
         metrics(std::make_unique<CacheMetrics>()),
-        db(std::make_unique<DatabaseConnection>()), cleanup_running(false) {
-    metrics->update_size(0);
-    metrics->update_memory(0);
+        storage(backend ? std::move(backend)
+                        : open_storage(StorageConfig::from_env())),
+        db(dynamic_cast<DatabaseConnection *>(storage.get())),
+        writes(!storage->persistent()
+                   ? nullptr
+                   : std::make_unique<WriteBehindQueue>(
+                         WriteBehindConfig::from_env(),
+                         [this](const std::vector<CacheRow> &rows) {
+                           if (rows.size() == 1 && !rows[0].deleted) {
+                             return timed(CacheMetrics::DbQuery::PUT, [&]() {
+                               return storage->put(rows[0].key, rows[0].value,
+                                                   rows[0].expiry);
+                             });
+                           }
+                           return timed(
+                               CacheMetrics::DbQuery::PUT_MANY,
+                               [&]() { return storage->put_many(rows); });
+                         },
+                         *metrics, [this]() { return storage->ready(); })),
+        refresh_config(RefreshConfig::from_env()),
+        refreshes(!refresh_config.enabled()
+                      ? nullptr
+                      : std::make_unique<RefreshQueue<K>>(
+                            refresh_config,
+                            [this](const K &key) {
+                              V value;
+                              load_through(key, value, true);
+                            })),
+        cleanup_running(false) {
+    if (capacity > 0) {
+      shard_count = std::min(shard_count, capacity / MIN_SHARD_CAPACITY);
+    }
+    if (max_bytes > 0) {
+      shard_count = std::min(shard_count, max_bytes / MIN_SHARD_BYTES);
+    }
+    if (db) {
+      db->set_pool_observers(
+          [this](double seconds) { metrics->observe_db_pool_wait(seconds); },
+          [this]() { metrics->record_db_broken_connection(); });
+    }
+    shard_count = std::max<size_t>(1, shard_count);
+    auto negative = NegativeCacheConfig::from_env();
+    for (size_t i = 0; i < shard_count; i++) {
+      size_t max_absent = negative.max_entries == 0
+                              ? 0
+                              : slice(negative.max_entries, i, shard_count);
+      shards.push_back(std::make_unique<Shard>(
+          slice(capacity, i, shard_count), slice(max_bytes, i, shard_count),
+          max_absent, negative.ttl));
+      shards.back()->mutex.observe(&metrics->lock_wait_histogram(),
+                                   &metrics->lock_hold_histogram());
+    }
+    metrics->register_shards(
+        shard_count, [this](size_t i) { return shards[i]->hits.load(); },
+        [this](size_t i) { return shards[i]->misses.load(); });
+    metrics->read_usage(
+        [this]() { return static_cast<double>(entry_count); },
+        [this]() {
+          size_t entries = entry_count, bytes = memory_bytes;
+          return static_cast<double>(bytes > entries * ENTRY_OVERHEAD
+                                         ? bytes - entries * ENTRY_OVERHEAD
+                                         : 0);
+        },
+        [this]() { return static_cast<double>(memory_bytes); });
     start_cleanup_thread();
   }
 
   ~LRUCache() {
-    cleanup_running = false;
+    {
+      std::lock_guard<std::mutex> lock(cleanup_mutex);
+      cleanup_running = false;
+    }
+    cleanup_cv.notify_all();
     if (cleanup_thread && cleanup_thread->joinable()) {
       cleanup_thread->join();
     }
+    if (storage_cleanup_thread && storage_cleanup_thread->joinable()) {
+      storage_cleanup_thread->join();
+    }
   }
 
-  DatabaseConnection *get_db() { return db.get(); }
+  // Null unless the storage is PostgreSQL, which export, import and the
+  // startup warm-up need.
+  DatabaseConnection *get_db() { return db; }
+  CacheMetrics *get_metrics() { return metrics.get(); }
 
+  // Expires in-memory entries every TIMER_TICK, and on a second thread
+  // purges expired rows from storage every DB_CLEANUP_INTERVAL.
   void start_cleanup_thread() {
     cleanup_running = true;
     cleanup_thread = std::make_unique<std::thread>([this]() {
+      std::unique_lock<std::mutex> lock(cleanup_mutex);
+      while (cleanup_running) {
+        lock.unlock();
+        expire();
+        lock.lock();
+        cleanup_cv.wait_for(lock, TIMER_TICK,
+                            [this]() { return !cleanup_running; });
+      }
+    });
+    if (!storage->persistent()) {
+      return;
+    }
+    storage_cleanup_thread = std::make_unique<std::thread>([this]() {
+      std::unique_lock<std::mutex> lock(cleanup_mutex);
       while (cleanup_running) {
-        db->cleanup_expired();
-        std::this_thread::sleep_for(std::chrono::minutes(5));
+        lock.unlock();
+        storage->cleanup_expired();
+        lock.lock();
+        cleanup_cv.wait_for(lock, DB_CLEANUP_INTERVAL,
+                            [this]() { return !cleanup_running; });
       }
     });
   }
 
-  void put(const K &key, const V &value,
+  // Removes every in-memory entry whose TTL has passed and returns how
+  // many; the cleanup thread calls this every TIMER_TICK.
+  size_t expire() {
+    uint64_t now = tick_of(std::chrono::steady_clock::now(), false);
+    size_t expired = 0;
+    for (auto &shard : shards) {
+      expired += expire(*shard, now);
+    }
+    if (expired > 0) {
+      metrics->record_expired(expired);
+    }
+    return expired;
+  }
+
+  // Stores in memory, then persists through the write-behind queue; whether
+  // this waits for the database depends on CACHE_WRITE_MODE. Returns false
+  // if the database write failed or was dropped (see
+  // WriteBehindQueue::write()); the value is still cached.
+  bool put(const K &key, const V &value,
            std::chrono::seconds ttl = std::chrono::seconds(0)) {
     if (ttl.count() == 0)
       ttl = default_ttl;
 
-    auto expiry = std::chrono::system_clock::now() + ttl;
-
-    auto future = std::async(std::launch::async, [this, key, value, expiry]() {
-      db->put(key, value, expiry);
-    });
+    store(key, value, ttl);
+    if (writes) {
+      return writes->write(key, value, std::chrono::system_clock::now() + ttl);
+    }
+    return true;
+  }
 
-    std::lock_guard<std::mutex> lock(cache_mutex);
+  // Removes the key from memory and the database. Returns whether it
+  // existed in either; a key only in the database costs a lookup. Sets
+  // `failed`, when given, if the database delete failed or was dropped.
+  bool remove(const K &key, bool *failed = nullptr) {
+    uint64_t hash = hasher(key);
+    Shard &shard = *shards[shard_index(hash)];
+    bool existed;
+    {
+      std::lock_guard<TimedMutex> lock(shard.mutex);
+      auto flight = shard.loading.find(key);
+      if (flight != shard.loading.end()) {
+        flight->second->superseded = true;
+      }
+      auto it = shard.cache_map.find(key);
+      existed = it != shard.cache_map.end() &&
+                std::chrono::steady_clock::now() <= it->second.expiry;
+      auto now = std::chrono::steady_clock::now();
+      if (it != shard.cache_map.end()) {
+        erase(shard, it);
+      } else if (shard.absent.contains(key, now)) {
+        return false;
+      }
+      shard.absent.insert(key, now);
+    }
+    // An entry evicted before its write was flushed still exists.
+    if (!existed && writes && writes->holds(key)) {
+      existed = true;
+    }
+    if (!existed && storage->ready()) {
+      existed = timed(CacheMetrics::DbQuery::GET,
+                      [&]() { return storage->get(key); })
+                    .has_value();
+    }
+    if (writes && !writes->erase(key) && failed) {
+      *failed = true;
+    }
+    return existed;
+  }
 
-    auto it = cache_map.find(key);
-    if (it != cache_map.end()) {
-      it->second = CacheEntry(value, ttl);
-      auto list_it = std::find(lru_list.begin(), lru_list.end(), key);
-      if (list_it != lru_list.end()) {
-        lru_list.erase(list_it);
+  // Seconds the key has left to live, reading it through from the
+  // database if needed; nullopt if it does not exist.
+  std::optional<std::chrono::seconds> remaining_ttl(const K &key) {
+    uint64_t hash = hasher(key);
+    Shard &shard = *shards[shard_index(hash)];
+    for (int attempt = 0; attempt < 2; attempt++) {
+      {
+        std::lock_guard<TimedMutex> lock(shard.mutex);
+        auto it = shard.cache_map.find(key);
+        auto now = std::chrono::steady_clock::now();
+        if (it != shard.cache_map.end() && now <= it->second.expiry) {
+          return std::chrono::ceil<std::chrono::seconds>(it->second.expiry -
+                                                         now);
+        }
+      }
+      V value;
+      if (attempt == 0 && !load_through(key, value)) {
+        return std::nullopt;
       }
-      lru_list.push_front(key);
-      return;
     }
+    return default_ttl; // loaded but too large to keep in memory
+  }
 
-    if (cache_map.size() >= capacity) {
-      evict();
+  // put() for a batch: each shard's lock is taken once, and the database
+  // writes share one transaction or write-behind wait. A key repeated in
+  // the batch keeps its last value. Returns false as put() does.
+  bool put_many(const std::vector<Entry> &entries) {
+    std::vector<size_t> unique = store_many(entries);
+    auto now = std::chrono::system_clock::now();
+    std::vector<CacheRow> rows;
+    rows.reserve(unique.size());
+    for (size_t i : unique) {
+      const Entry &entry = entries[i];
+      rows.push_back({entry.key, entry.value,
+                      now + (entry.ttl.count() == 0 ? default_ttl : entry.ttl)});
     }
+    return !writes || writes->write_many(rows);
+  }
 
-    cache_map.insert({key, CacheEntry(value, ttl)});
-    lru_list.push_front(key);
+  // Waits until every write queued by put() has reached the database.
+  void flush() {
+    if (writes) {
+      writes->flush();
+    }
   }
 
-  bool get(const K &key, V &value) {
-    {
-      std::lock_guard<std::mutex> lock(cache_mutex);
-
-      auto it = cache_map.find(key);
-      if (it != cache_map.end()) {
-        if (std::chrono::steady_clock::now() <= it->second.expiry) {
-          metrics->record_hit();
-          value = it->second.value;
-          auto list_it = std::find(lru_list.begin(), lru_list.end(), key);
-          if (list_it != lru_list.end()) {
-            lru_list.erase(list_it);
-          }
-          lru_list.push_front(key);
-          return true;
+  // Inserts into memory only, for values that are already persisted.
+  void load(const K &key, const V &value,
+            std::chrono::seconds ttl = std::chrono::seconds(0)) {
+    store(key, value, ttl.count() == 0 ? default_ttl : ttl);
+  }
+
+  // load() for a batch, taking each shard's lock once.
+  void load_many(const std::vector<Entry> &entries) { store_many(entries); }
+
+  // load_many() for a warm-up read from the database: keys already cached,
+  // being loaded, or recently removed are left alone, since their rows may
+  // predate the live traffic, and nothing is evicted to make room. Returns
+  // how many entries were stored.
+  size_t warm_many(const std::vector<Entry> &entries) {
+    std::vector<uint64_t> hashes(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+      hashes[i] = hasher(entries[i].key);
+    }
+
+    size_t stored = 0;
+    auto groups = group_by_shard(hashes);
+    auto now = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < shards.size(); s++) {
+      if (groups[s].empty()) {
+        continue;
+      }
+      Shard &shard = *shards[s];
+      std::lock_guard<TimedMutex> lock(shard.mutex);
+      for (size_t i : groups[s]) {
+        const Entry &entry = entries[i];
+        size_t bytes = ENTRY_OVERHEAD + cache_payload_bytes(entry.key) +
+                       cache_payload_bytes(entry.value);
+        if (shard.cache_map.size() >= shard.capacity ||
+            shard.bytes + bytes > shard.max_bytes ||
+            shard.cache_map.count(entry.key) != 0 ||
+            shard.loading.count(entry.key) != 0 ||
+            shard.absent.contains(entry.key, now)) {
+          continue;
         }
-        cache_map.erase(it);
-        metrics->record_expired();
-        metrics->update_size(cache_map.size());
+        store_locked(shard, entry.key, hashes[i], entry.value,
+                     entry.ttl.count() == 0 ? default_ttl : entry.ttl);
+        stored++;
       }
     }
-    auto db_value = db->get(key);
-    if (db_value) {
-      value = *db_value;
-      metrics->record_hit();
-      put(key, value);
+    return stored;
+  }
+
+  // Whether every shard is at its entry or byte limit, so warm_many()
+  // would store nothing more.
+  bool full() const {
+    for (const auto &shard : shards) {
+      std::lock_guard<TimedMutex> lock(shard->mutex);
+      if (shard->cache_map.size() < shard->capacity &&
+          shard->bytes + ENTRY_OVERHEAD < shard->max_bytes) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Reads the in-memory entry only; never waits on the database.
+  bool lookup(const K &key, V &value) {
+    if (find_in_memory(key, value)) {
       return true;
     }
     metrics->record_miss();
     return false;
   }
 
+  // Reads through to the database on a miss. Concurrent misses for one key
+  // share a single query, and the loaded row is cached for the rest of its
+  // TTL without being written back. Given `stale`, an entry expired within
+  // CACHE_SERVE_STALE_SECS is returned while it reloads, and `stale` says
+  // so.
+  bool get(const K &key, V &value, bool *stale = nullptr) {
+    if (stale) {
+      *stale = false;
+    }
+    if (find_in_memory(key, value, stale)) {
+      return true;
+    }
+    bool found = load_through(key, value);
+    if (found) {
+      metrics->record_hit();
+    } else {
+      metrics->record_miss();
+    }
+    return found;
+  }
+
+  // get() for a batch: each shard's lock is taken once, and every miss is
+  // read through in a single database query. Results line up with `keys`.
+  std::vector<std::optional<V>> get_many(const std::vector<K> &keys) {
+    std::vector<std::optional<V>> values(keys.size());
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      hashes[i] = hasher(keys[i]);
+    }
+
+    auto groups = group_by_shard(hashes);
+    std::vector<size_t> missed;
+    size_t avoided = 0;
+    auto steady_now = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < shards.size(); s++) {
+      if (groups[s].empty()) {
+        continue;
+      }
+      std::lock_guard<TimedMutex> lock(shards[s]->mutex);
+      for (size_t i : groups[s]) {
+        V value;
+        if (find_locked(*shards[s], keys[i], hashes[i], value)) {
+          values[i] = std::move(value);
+        } else if (shards[s]->absent.contains(keys[i], steady_now)) {
+          metrics->record_miss();
+          avoided++;
+        } else {
+          missed.push_back(i);
+        }
+      }
+    }
+    if (avoided > 0) {
+      metrics->record_db_lookup_avoided(avoided);
+    }
+    if (missed.empty() || !storage->ready()) {
+      metrics->record_miss(missed.size());
+      return values;
+    }
+
+    std::vector<K> missed_keys;
+    for (size_t i : missed) {
+      missed_keys.push_back(keys[i]);
+    }
+    std::unordered_map<K, CacheRow, Hash> loaded;
+    uint64_t flushes = writes ? writes->flushes() : 0;
+    bool failed = false;
+    auto rows = timed(CacheMetrics::DbQuery::GET_MANY, [&]() {
+      return storage->get_many(missed_keys, &failed);
+    });
+    for (auto &row : rows) {
+      K key = row.key;
+      loaded.emplace(std::move(key), std::move(row));
+    }
+
+    // Cache what was loaded, and remember what was not, unless a put() got
+    // there first or the query failed.
+    auto now = std::chrono::system_clock::now();
+    steady_now = std::chrono::steady_clock::now();
+    std::vector<uint64_t> missed_hashes;
+    for (size_t i : missed) {
+      missed_hashes.push_back(hashes[i]);
+    }
+    auto missed_groups = group_by_shard(missed_hashes);
+    for (size_t s = 0; s < shards.size(); s++) {
+      if (missed_groups[s].empty()) {
+        continue;
+      }
+      Shard &shard = *shards[s];
+      std::lock_guard<TimedMutex> lock(shard.mutex);
+      for (size_t j : missed_groups[s]) {
+        const K &key = keys[missed[j]];
+        // A fresh entry came from a put(); an expired one, kept for stale
+        // serving, is replaced.
+        auto entry = shard.cache_map.find(key);
+        if (entry != shard.cache_map.end() &&
+            steady_now <= entry->second.expiry) {
+          continue;
+        }
+        auto row = loaded.find(key);
+        if (row == loaded.end()) {
+          if (!failed && settled(key, flushes)) {
+            shard.absent.insert(key, steady_now);
+          }
+          continue;
+        }
+        auto ttl =
+            std::chrono::ceil<std::chrono::seconds>(row->second.expiry - now);
+        store_locked(shard, key, missed_hashes[j], row->second.value,
+                     std::max(ttl, std::chrono::seconds(1)));
+      }
+    }
+
+    for (size_t i : missed) {
+      auto row = loaded.find(keys[i]);
+      if (row != loaded.end()) {
+        values[i] = row->second.value;
+        metrics->record_hit();
+      } else {
+        metrics->record_miss();
+      }
+    }
+    return values;
+  }
+
   void clear() {
-    std::lock_guard<std::mutex> lock(cache_mutex);
-    cache_map.clear();
-    lru_list.clear();
+    for (auto &shard : shards) {
+      std::lock_guard<TimedMutex> lock(shard->mutex);
+      entry_count -= shard->cache_map.size();
+      memory_bytes -= shard->bytes;
+      shard->cache_map.clear();
+      shard->policy.clear();
+      shard->timers.clear();
+      shard->absent.clear();
+      shard->bytes = 0;
+    }
   }
 
-  size_t size() const { return cache_map.size(); }
+  size_t size() const { return entry_count; }
+
+  // Bytes charged for all entries; stays within max_bytes() when set.
+  size_t memory_usage() const { return memory_bytes; }
+
+  size_t max_memory() const { return max_bytes; }
+
+  size_t shard_count() const { return shards.size(); }
+
+  // In-memory hit/miss counts per shard; database read-through results
+  // count as shard misses.
+  std::vector<ShardStats> shard_stats() const {
+    std::vector<ShardStats> stats;
+    for (const auto &shard : shards) {
+      std::lock_guard<TimedMutex> lock(shard->mutex);
+      stats.push_back({shard->hits.load(), shard->misses.load(),
+                       shard->cache_map.size(), shard->capacity,
+                       shard->bytes});
+    }
+    return stats;
+  }
 };
 
 #endif
@@ -1,22 +1,70 @@
 #ifndef DATABASE_HPP
 #define DATABASE_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
-#include <future>
+#include <ctime>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include "storage.hpp"
 #include <pqxx/pqxx>
 #include <pwd.h>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unistd.h>
+#include <utility>
+#include <vector>
 
-class DatabaseConnection {
+// A row of an import, timestamps as PostgreSQL accepts them (for example
+// "2024-10-27 02:01:25"). An empty created_at means now.
+struct ImportRow {
+  std::string key;
+  std::string value;
+  std::string expiry;
+  std::string created_at;
+};
+
+// A pool of PostgreSQL connections, each with the cache's statements
+// prepared. Callers lease a connection per operation, so reads and writes
+// from different threads run in parallel up to the pool size.
+//
+// The first connection is made in the background, retrying until the
+// database is reachable, so the server starts serving from memory at once.
+// Until then ready() is false and every query fails fast.
+class DatabaseConnection : public Storage {
 private:
-  std::unique_ptr<pqxx::connection> conn;
-  std::mutex db_mutex;
-  std::string db_host, db_port, db_name, db_user, db_password;
+  struct IdleConnection {
+    std::unique_ptr<pqxx::connection> conn;
+    std::chrono::steady_clock::time_point last_used;
+  };
+
+  // Connections idle longer than this are pinged before being handed out.
+  static constexpr std::chrono::seconds HEALTH_CHECK_AFTER{30};
+  // Rows per statement in put_many().
+  static const size_t PUT_CHUNK = 512;
+  // Longest wait between connect attempts at startup.
+  static constexpr std::chrono::seconds MAX_CONNECT_BACKOFF{30};
+
+  std::string conn_string;
+  size_t pool_size = 8;
+  std::chrono::milliseconds acquire_timeout{5000};
+  std::mutex pool_mutex;
+  std::condition_variable pool_available;
+  std::vector<IdleConnection> idle;
+  size_t open_connections = 0; // idle plus leased
+  std::function<void(double)> on_pool_wait;
+  std::function<void()> on_broken_connection;
+  std::atomic<bool> connected{false}; // set under pool_mutex
+  bool stopping = false;              // guarded by pool_mutex
+  std::thread connector;
 
   std::string get_system_username() {
     // Try getenv first (most reliable on macOS)
@@ -38,6 +86,139 @@ private:
     return value ? std::string(value) : default_value;
   }
 
+  // Local time, matching the TIMESTAMP column and CURRENT_TIMESTAMP.
+  static std::string format_timestamp(std::chrono::system_clock::time_point t) {
+    std::time_t time = std::chrono::system_clock::to_time_t(t);
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time), "%Y-%m-%d %H:%M:%S");
+    return ss.str();
+  }
+
+  static void prepare_statements(pqxx::connection &conn) {
+    conn.prepare("cache_get",
+                 "SELECT value, CEIL(EXTRACT(EPOCH FROM "
+                 "expiry - CURRENT_TIMESTAMP::timestamp))::bigint "
+                 "FROM cache_entries "
+                 "WHERE key = $1 AND expiry > CURRENT_TIMESTAMP::timestamp");
+    conn.prepare("cache_get_many",
+                 "SELECT key, value, CEIL(EXTRACT(EPOCH FROM "
+                 "expiry - CURRENT_TIMESTAMP::timestamp))::bigint "
+                 "FROM cache_entries WHERE key = ANY($1::text[]) "
+                 "AND expiry > CURRENT_TIMESTAMP::timestamp");
+    conn.prepare("cache_put", "INSERT INTO cache_entries (key, value, expiry) "
+                              "VALUES ($1, $2, $3::timestamp) "
+                              "ON CONFLICT (key) DO UPDATE "
+                              "SET value = EXCLUDED.value, "
+                              "expiry = EXCLUDED.expiry");
+    conn.prepare("cache_put_many",
+                 "INSERT INTO cache_entries (key, value, expiry) "
+                 "SELECT * FROM unnest($1::text[], $2::text[], "
+                 "$3::timestamp[]) "
+                 "ON CONFLICT (key) DO UPDATE "
+                 "SET value = EXCLUDED.value, "
+                 "expiry = EXCLUDED.expiry");
+    conn.prepare("cache_delete_many",
+                 "DELETE FROM cache_entries WHERE key = ANY($1::text[])");
+    conn.prepare("cache_cleanup", "DELETE FROM cache_entries WHERE expiry <= "
+                                  "CURRENT_TIMESTAMP::timestamp");
+  }
+
+  // Connects with exponential backoff until it succeeds or the pool is
+  // destroyed, creates the cache table, then opens the pool.
+  void connect() {
+    std::chrono::seconds wait_time(1);
+    for (int attempt = 1;; attempt++) {
+      try {
+        auto conn = std::make_unique<pqxx::connection>(conn_string);
+
+        // Create cache table if it doesn't exist
+        pqxx::work txn(*conn);
+        txn.exec("CREATE TABLE IF NOT EXISTS cache_entries ("
+                 "key TEXT PRIMARY KEY,"
+                 "value TEXT NOT NULL,"
+                 "expiry TIMESTAMP NOT NULL,"
+                 "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
+                 ")");
+        // Lets the boot warm-up read the newest rows without sorting the
+        // whole table.
+        txn.exec("CREATE INDEX IF NOT EXISTS cache_entries_created_at_idx "
+                 "ON cache_entries (created_at DESC)");
+        txn.commit();
+
+        // Further connections are opened on demand, up to pool_size.
+        prepare_statements(*conn);
+        {
+          std::lock_guard<std::mutex> lock(pool_mutex);
+          idle.push_back({std::move(conn), std::chrono::steady_clock::now()});
+          open_connections = 1;
+          connected = true;
+        }
+        pool_available.notify_all();
+        std::cout << "Database connection and initialization successful!"
+                  << std::endl;
+        return;
+      } catch (const std::exception &e) {
+        std::cerr << "Connection attempt " << attempt
+                  << " failed: " << e.what() << ". Retrying in "
+                  << wait_time.count() << " seconds..." << std::endl;
+      }
+
+      std::unique_lock<std::mutex> lock(pool_mutex);
+      if (pool_available.wait_for(lock, wait_time,
+                                  [this]() { return stopping; })) {
+        return;
+      }
+      wait_time = std::min(wait_time * 2, MAX_CONNECT_BACKOFF);
+    }
+  }
+
+  std::unique_ptr<pqxx::connection> open_connection() {
+    auto conn = std::make_unique<pqxx::connection>(conn_string);
+    prepare_statements(*conn);
+    return conn;
+  }
+
+  static bool healthy(pqxx::connection &conn) {
+    try {
+      pqxx::nontransaction txn(conn);
+      txn.exec("SELECT 1");
+      return true;
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+
+  void release(std::unique_ptr<pqxx::connection> conn) {
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      if (conn) {
+        idle.push_back({std::move(conn), std::chrono::steady_clock::now()});
+      } else {
+        open_connections--;
+      }
+    }
+    pool_available.notify_one();
+  }
+
+  // PostgreSQL array literal with every element quoted, for passing a
+  // whole column as one parameter.
+  static std::string array_literal(const std::vector<std::string> &items) {
+    std::string out = "{";
+    for (size_t i = 0; i < items.size(); i++) {
+      if (i > 0)
+        out += ',';
+      out += '"';
+      for (char c : items[i]) {
+        if (c == '"' || c == '\\')
+          out += '\\';
+        out += c;
+      }
+      out += '"';
+    }
+    out += '}';
+    return out;
+  }
+
 public:
   DatabaseConnection(const std::string &host = "", const std::string &port = "",
                      const std::string &dbname = "",
@@ -62,120 +243,380 @@ public:
                             : get_env_or_default("POSTGRES_PASSWORD", "");
 
       // Build connection string
-      std::string conn_string = "host=" + actual_host + " port=" + actual_port +
-                                " dbname=" + actual_dbname +
-                                " user=" + actual_user;
+      conn_string = "host=" + actual_host + " port=" + actual_port +
+                    " dbname=" + actual_dbname + " user=" + actual_user;
 
       // Add password if available
       if (!actual_password.empty()) {
         conn_string += " password=" + actual_password;
       }
 
+      if (const char *size = std::getenv("POSTGRES_POOL_SIZE")) {
+        pool_size = std::max(1L, std::strtol(size, nullptr, 10));
+      }
+      if (const char *timeout = std::getenv("POSTGRES_POOL_TIMEOUT_MS")) {
+        acquire_timeout = std::chrono::milliseconds(
+            std::max(1L, std::strtol(timeout, nullptr, 10)));
+      }
+
       std::cout << "Attempting database connection..." << std::endl;
       std::cout << "Host: " << actual_host << ", Port: " << actual_port
                 << ", DB: " << actual_dbname << ", User: " << actual_user
                 << std::endl;
+      connector = std::thread([this]() { connect(); });
+    } catch (const std::exception &e) {
+      throw std::runtime_error("Database connection failed: " +
+                               std::string(e.what()));
+    }
+  }
 
-      // Try to connect with exponential backoff
-      int retry_count = 0;
-      const int max_retries = 5;
-      std::chrono::seconds wait_time(1);
+  ~DatabaseConnection() {
+    {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      stopping = true;
+    }
+    pool_available.notify_all();
+    if (connector.joinable()) {
+      connector.join();
+    }
+  }
 
-      while (retry_count < max_retries) {
-        try {
-          conn = std::make_unique<pqxx::connection>(conn_string);
-          break;
-        } catch (const std::exception &e) {
-          retry_count++;
-          if (retry_count == max_retries) {
-            throw;
-          }
-          std::cerr << "Connection attempt " << retry_count
-                    << " failed: " << e.what() << ". Retrying in "
-                    << wait_time.count() << " seconds..." << std::endl;
-          std::this_thread::sleep_for(wait_time);
-          wait_time *= 2; // Exponential backoff
-        }
+  bool ready() const override { return connected; }
+
+  // Waits up to `timeout` for the first connection; returns ready().
+  bool wait_ready(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    return pool_available.wait_for(lock, timeout,
+                                   [this]() { return connected.load(); });
+  }
+
+  // Exclusive use of one pooled connection, returned to the pool when the
+  // lease ends. discard() drops a connection that turned out to be broken.
+  class Lease {
+  private:
+    DatabaseConnection *pool;
+    std::unique_ptr<pqxx::connection> conn;
+
+  public:
+    Lease(DatabaseConnection *pool, std::unique_ptr<pqxx::connection> conn)
+        : pool(pool), conn(std::move(conn)) {}
+    Lease(Lease &&other)
+        : pool(std::exchange(other.pool, nullptr)),
+          conn(std::move(other.conn)) {}
+    Lease &operator=(Lease &&) = delete;
+    ~Lease() {
+      if (pool) {
+        pool->release(std::move(conn));
       }
+    }
 
-      // Create cache table if it doesn't exist
-      pqxx::work txn(*conn);
-      txn.exec("CREATE TABLE IF NOT EXISTS cache_entries ("
-               "key TEXT PRIMARY KEY,"
-               "value TEXT NOT NULL,"
-               "expiry TIMESTAMP NOT NULL,"
-               "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP"
-               ")");
-      txn.commit();
+    pqxx::connection &operator*() { return *conn; }
 
-      std::cout << "Database connection and initialization successful!"
-                << std::endl;
+    void discard() {
+      conn.reset();
+      if (pool->on_broken_connection) {
+        pool->on_broken_connection();
+      }
+    }
+  };
 
-    } catch (const std::exception &e) {
-      throw std::runtime_error("Database connection failed: " +
-                               std::string(e.what()));
+  // Called with the seconds each acquire() waited, and whenever a broken
+  // connection is dropped. Set before the pool is shared between threads.
+  void set_pool_observers(std::function<void(double)> on_wait,
+                          std::function<void()> on_broken) {
+    on_pool_wait = std::move(on_wait);
+    on_broken_connection = std::move(on_broken);
+  }
+
+  // Most connections open at once (POSTGRES_POOL_SIZE).
+  size_t max_connections() const { return pool_size; }
+
+  // Leases an idle connection, opening a new one while fewer than
+  // pool_size are open and waiting otherwise. A connection that has sat
+  // idle past HEALTH_CHECK_AFTER is pinged and reopened if dead. Throws if
+  // none frees up within POSTGRES_POOL_TIMEOUT_MS or a connect fails, and
+  // at once while the first connection is still being made.
+  Lease acquire() {
+    if (!connected) {
+      throw std::runtime_error("Database not connected yet");
     }
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (!pool_available.wait_until(lock, start + acquire_timeout, [this]() {
+          return !idle.empty() || open_connections < pool_size;
+        })) {
+      throw std::runtime_error("Timed out waiting for a database connection");
+    }
+    if (on_pool_wait) {
+      on_pool_wait(std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count());
+    }
+
+    std::unique_ptr<pqxx::connection> conn;
+    bool stale = false;
+    if (!idle.empty()) {
+      conn = std::move(idle.back().conn);
+      stale = std::chrono::steady_clock::now() - idle.back().last_used >
+              HEALTH_CHECK_AFTER;
+      idle.pop_back();
+    } else {
+      open_connections++; // reserve the slot before connecting unlocked
+    }
+    lock.unlock();
+
+    try {
+      if (stale && !healthy(*conn)) {
+        conn.reset();
+        if (on_broken_connection) {
+          on_broken_connection();
+        }
+      }
+      if (!conn) {
+        conn = open_connection();
+      }
+    } catch (...) {
+      release(nullptr);
+      throw;
+    }
+    return Lease(this, std::move(conn));
   }
 
-  pqxx::connection *get_connection() { return conn.get(); }
+  // Runs `fn` with exclusive use of a pooled connection.
+  template <typename Fn> auto with_connection(Fn &&fn) {
+    Lease lease = acquire();
+    try {
+      return fn(*lease);
+    } catch (const pqxx::broken_connection &) {
+      lease.discard();
+      throw;
+    }
+  }
 
-  // Rest of your existing methods remain the same...
   bool put(const std::string &key, const std::string &value,
-           const std::chrono::system_clock::time_point &expiry) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+           const std::chrono::system_clock::time_point &expiry) override {
     try {
-      pqxx::work txn(*conn);
+      return with_connection([&](pqxx::connection &conn) {
+        pqxx::work txn(conn);
+        txn.exec_prepared("cache_put", key, value, format_timestamp(expiry));
+        txn.commit();
+        return true;
+      });
+    } catch (const std::exception &e) {
+      std::cerr << "Database error: " << e.what() << std::endl;
+      return false;
+    }
+  }
 
-      // Convert time_point to PostgreSQL timestamp string
-      std::time_t t = std::chrono::system_clock::to_time_t(expiry);
-      std::stringstream ss;
-      ss << std::put_time(std::localtime(&t), "%Y-%m-%d %H:%M:%S");
+  // Upserts all rows in one transaction, PUT_CHUNK rows per statement, each
+  // statement unnesting its columns from array parameters. Rows marked
+  // deleted are removed in the same transaction instead.
+  bool put_many(const std::vector<CacheRow> &rows) override {
+    const size_t chunk = PUT_CHUNK;
+    try {
+      return with_connection([&](pqxx::connection &conn) {
+        pqxx::work txn(conn);
+        std::vector<std::string> keys, values, expiries, deleted;
+        for (size_t begin = 0; begin < rows.size(); begin += chunk) {
+          size_t end = std::min(rows.size(), begin + chunk);
+          keys.clear();
+          values.clear();
+          expiries.clear();
+          deleted.clear();
+          for (size_t i = begin; i < end; i++) {
+            if (rows[i].deleted) {
+              deleted.push_back(rows[i].key);
+              continue;
+            }
+            keys.push_back(rows[i].key);
+            values.push_back(rows[i].value);
+            expiries.push_back(format_timestamp(rows[i].expiry));
+          }
+          if (!keys.empty()) {
+            txn.exec_prepared("cache_put_many", array_literal(keys),
+                              array_literal(values), array_literal(expiries));
+          }
+          if (!deleted.empty()) {
+            txn.exec_prepared("cache_delete_many", array_literal(deleted));
+          }
+        }
+        txn.commit();
+        return true;
+      });
+    } catch (const std::exception &e) {
+      std::cerr << "Database error: " << e.what() << std::endl;
+      return false;
+    }
+  }
 
-      txn.exec_params("INSERT INTO cache_entries (key, value, expiry) "
-                      "VALUES ($1, $2, $3::timestamp) "
-                      "ON CONFLICT (key) DO UPDATE "
-                      "SET value = EXCLUDED.value, "
-                      "expiry = EXCLUDED.expiry",
-                      key, value, ss.str());
+  std::optional<std::string>
+  get(const std::string &key, std::chrono::seconds *remaining_ttl = nullptr,
+      bool *failed = nullptr) override {
+    try {
+      return with_connection(
+          [&](pqxx::connection &conn) -> std::optional<std::string> {
+            pqxx::work txn(conn);
+            auto result = txn.exec_prepared("cache_get", key);
+            txn.commit();
 
-      txn.commit();
-      return true;
+            if (result.empty()) {
+              return std::nullopt;
+            }
+            if (remaining_ttl) {
+              *remaining_ttl = std::chrono::seconds(
+                  std::max<int64_t>(1, result[0][1].as<int64_t>()));
+            }
+            return result[0][0].as<std::string>();
+          });
     } catch (const std::exception &e) {
       std::cerr << "Database error: " << e.what() << std::endl;
-      return false;
+      if (failed) {
+        *failed = true;
+      }
+      return std::nullopt;
     }
   }
 
-  std::optional<std::string> get(const std::string &key) {
-    std::lock_guard<std::mutex> lock(db_mutex);
+  // Looks up every key in one query.
+  std::vector<CacheRow> get_many(const std::vector<std::string> &keys,
+                                 bool *failed = nullptr) override {
+    if (keys.empty()) {
+      return {};
+    }
     try {
-      pqxx::work txn(*conn);
+      return with_connection([&](pqxx::connection &conn) {
+        pqxx::work txn(conn);
+        auto result = txn.exec_prepared("cache_get_many", array_literal(keys));
+        txn.commit();
 
-      auto result = txn.exec_params(
-          "SELECT value FROM cache_entries "
-          "WHERE key = $1 AND expiry > CURRENT_TIMESTAMP::timestamp",
-          key);
+        auto now = std::chrono::system_clock::now();
+        std::vector<CacheRow> rows;
+        rows.reserve(result.size());
+        for (const auto &row : result) {
+          rows.push_back({row[0].as<std::string>(), row[1].as<std::string>(),
+                          now + std::chrono::seconds(row[2].as<int64_t>())});
+        }
+        return rows;
+      });
+    } catch (const std::exception &e) {
+      std::cerr << "Database error: " << e.what() << std::endl;
+      if (failed) {
+        *failed = true;
+      }
+      return {};
+    }
+  }
+
+  // Walks the live rows (key, value, expiry, created_at) through a
+  // server-side cursor, `batch` rows per FETCH, so memory stays bounded
+  // however large the table is. `on_batch` gets each non-empty result and
+  // returns false to stop early. Holds one pooled connection throughout and
+  // throws on database errors.
+  template <typename Fn> void scan_live(size_t batch, Fn &&on_batch) {
+    with_connection([&](pqxx::connection &conn) {
+      pqxx::read_transaction txn(conn);
+      txn.exec("DECLARE cache_scan NO SCROLL CURSOR FOR "
+               "SELECT key, value, expiry, created_at FROM cache_entries "
+               "WHERE expiry > CURRENT_TIMESTAMP");
+      const std::string fetch =
+          "FETCH FORWARD " + std::to_string(batch) + " FROM cache_scan";
+      while (true) {
+        pqxx::result rows = txn.exec(fetch);
+        if (rows.empty() || !on_batch(rows)) {
+          break;
+        }
+      }
+      txn.commit();
+    });
+  }
 
+  // Walks the `limit` most recently created live rows (all if 0) of one
+  // hash partition of the keys (0 <= partition < partitions), newest first,
+  // as (key, value, remaining whole seconds) through a server-side cursor,
+  // `batch` rows per FETCH. Scans of different partitions never overlap, so
+  // they can run in parallel on separate connections. `on_batch` returns
+  // false to stop early. Throws on database errors.
+  template <typename Fn>
+  void scan_recent(size_t partition, size_t partitions, size_t limit,
+                   size_t batch, Fn &&on_batch) {
+    with_connection([&](pqxx::connection &conn) {
+      pqxx::read_transaction txn(conn);
+      // hashtext() is a signed int4; shifting it to non-negative keeps the
+      // modulus in range.
+      txn.exec("DECLARE cache_warm NO SCROLL CURSOR FOR "
+               "SELECT key, value, CEIL(EXTRACT(EPOCH FROM "
+               "expiry - CURRENT_TIMESTAMP::timestamp))::bigint "
+               "FROM cache_entries "
+               "WHERE expiry > CURRENT_TIMESTAMP::timestamp AND "
+               "(hashtext(key)::bigint + 2147483648) % " +
+               std::to_string(partitions) + " = " + std::to_string(partition) +
+               " ORDER BY created_at DESC NULLS LAST LIMIT " +
+               (limit == 0 ? std::string("ALL") : std::to_string(limit)));
+      const std::string fetch =
+          "FETCH FORWARD " + std::to_string(batch) + " FROM cache_warm";
+      while (true) {
+        pqxx::result rows = txn.exec(fetch);
+        if (rows.empty() || !on_batch(rows)) {
+          break;
+        }
+      }
       txn.commit();
+    });
+  }
 
-      if (result.empty()) {
-        return std::nullopt;
+  // COPYs the rows into a staging table and merges them into cache_entries
+  // in one transaction, skipping rows that have already expired. Keys must
+  // be unique within the batch. Returns the key and remaining lifetime of
+  // every row merged. Throws on database errors.
+  std::vector<std::pair<std::string, std::chrono::seconds>>
+  import_rows(const std::vector<ImportRow> &rows) {
+    return with_connection([&](pqxx::connection &conn) {
+      pqxx::work txn(conn);
+      txn.exec("CREATE TEMP TABLE cache_import (key TEXT, value TEXT, "
+               "expiry TIMESTAMP, created_at TIMESTAMP) ON COMMIT DROP");
+      auto copy = pqxx::stream_to::table(
+          txn, {"cache_import"}, {"key", "value", "expiry", "created_at"});
+      for (const auto &row : rows) {
+        std::optional<std::string_view> created_at;
+        if (!row.created_at.empty()) {
+          created_at = row.created_at;
+        }
+        copy.write_values(row.key, row.value, row.expiry, created_at);
       }
+      copy.complete();
 
-      return result[0][0].as<std::string>();
-    } catch (const std::exception &e) {
-      std::cerr << "Database error: " << e.what() << std::endl;
-      return std::nullopt;
-    }
+      auto result = txn.exec(
+          "INSERT INTO cache_entries (key, value, expiry, created_at) "
+          "SELECT key, value, expiry, "
+          "COALESCE(created_at, CURRENT_TIMESTAMP) FROM cache_import "
+          "WHERE expiry > CURRENT_TIMESTAMP::timestamp "
+          "ON CONFLICT (key) DO UPDATE "
+          "SET value = EXCLUDED.value, expiry = EXCLUDED.expiry "
+          "RETURNING key, CEIL(EXTRACT(EPOCH FROM "
+          "expiry - CURRENT_TIMESTAMP::timestamp))::bigint");
+      txn.commit();
+
+      std::vector<std::pair<std::string, std::chrono::seconds>> merged;
+      merged.reserve(result.size());
+      for (const auto &row : result) {
+        merged.emplace_back(
+            row[0].as<std::string>(),
+            std::chrono::seconds(std::max<int64_t>(1, row[1].as<int64_t>())));
+      }
+      return merged;
+    });
   }
 
-  void cleanup_expired() {
-    std::lock_guard<std::mutex> lock(db_mutex);
+  void cleanup_expired() override {
+    if (!connected) {
+      return;
+    }
     try {
-      pqxx::work txn(*conn);
-      txn.exec("DELETE FROM cache_entries WHERE expiry <= "
-               "CURRENT_TIMESTAMP::timestamp");
-      txn.commit();
+      with_connection([&](pqxx::connection &conn) {
+        pqxx::work txn(conn);
+        txn.exec_prepared("cache_cleanup");
+        txn.commit();
+      });
     } catch (const std::exception &e) {
       std::cerr << "Database cleanup error: " << e.what() << std::endl;
     }
@@ -0,0 +1,243 @@
+#ifndef EVICTION_HPP
+#define EVICTION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+// Eviction policies order one cache shard's entries and pick what to evict.
+// The shard owns the entries and calls into its policy under its lock:
+//
+//   Handle admit(const K *key, uint64_t hash)  a new entry was inserted
+//   void access(Handle &h, uint64_t hash)      an entry was read or rewritten
+//   void remove(Handle h)                      an entry left the shard
+//   const K *victim()                          next key to evict, or nullptr
+//   void clear()
+//
+// Keys are passed as pointers into the shard's map, which stay valid until
+// the entry is removed. `hash` is the key's unmixed std::hash value.
+
+// Plain least-recently-used order.
+template <typename K> class LruPolicy {
+private:
+  std::list<const K *> order; // most recent first
+
+public:
+  using Handle = typename std::list<const K *>::iterator;
+
+  explicit LruPolicy(size_t /*expected_entries*/) {}
+
+  Handle admit(const K *key, uint64_t /*hash*/) {
+    order.push_front(key);
+    return order.begin();
+  }
+
+  void access(Handle &handle, uint64_t /*hash*/) {
+    order.splice(order.begin(), order, handle);
+  }
+
+  void remove(Handle handle) { order.erase(handle); }
+
+  const K *victim() const { return order.empty() ? nullptr : order.back(); }
+
+  void clear() { order.clear(); }
+};
+
+// Count-min sketch of 4-bit counters estimating how often a hash has been
+// seen recently, with 16 counters per expected entry to keep collisions
+// rare. Every counter is halved once the number of increments reaches ten
+// times the expected entries, so old popularity decays.
+class FrequencySketch {
+private:
+  static const int DEPTH = 4;
+  std::vector<uint64_t> table; // 16 counters per word
+  size_t width_mask;
+  size_t additions = 0;
+  size_t sample_size;
+
+  static uint64_t mix(uint64_t h, int row) {
+    static const uint64_t SEEDS[DEPTH] = {
+        0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL,
+        0xcbf29ce484222325ULL};
+    h = (h + SEEDS[row]) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+  }
+
+  size_t counter_index(uint64_t hash, int row) const {
+    return row * (width_mask + 1) + (mix(hash, row) & width_mask);
+  }
+
+  unsigned counter(size_t index) const {
+    return (table[index / 16] >> ((index % 16) * 4)) & 0xF;
+  }
+
+  void halve() {
+    for (auto &word : table) {
+      word = (word >> 1) & 0x7777777777777777ULL;
+    }
+    additions /= 2;
+  }
+
+public:
+  explicit FrequencySketch(size_t expected_entries) {
+    size_t entries = 16;
+    while (entries < expected_entries && entries < (size_t(1) << 24)) {
+      entries <<= 1;
+    }
+    size_t width = 4 * entries; // per row, so 16 counters per entry
+    width_mask = width - 1;
+    table.assign(DEPTH * width / 16, 0);
+    sample_size = 10 * entries;
+  }
+
+  void increment(uint64_t hash) {
+    bool added = false;
+    for (int row = 0; row < DEPTH; row++) {
+      size_t index = counter_index(hash, row);
+      if (counter(index) < 15) {
+        table[index / 16] += uint64_t(1) << ((index % 16) * 4);
+        added = true;
+      }
+    }
+    if (added && ++additions >= sample_size) {
+      halve();
+    }
+  }
+
+  unsigned frequency(uint64_t hash) const {
+    unsigned estimate = 15;
+    for (int row = 0; row < DEPTH; row++) {
+      estimate = std::min(estimate, counter(counter_index(hash, row)));
+    }
+    return estimate;
+  }
+
+  void clear() {
+    std::fill(table.begin(), table.end(), 0);
+    additions = 0;
+  }
+};
+
+// W-TinyLFU: new entries land in a small LRU window. Once the window is
+// over its share, its oldest entry is only admitted to the main region if
+// the frequency sketch rates it above main's own eviction candidate;
+// otherwise it is evicted instead. Main is a segmented LRU: entries enter
+// on probation and move to the protected segment when hit again. One-off
+// keys, such as those from a full scan, pass through the window without
+// displacing the hot set.
+template <typename K> class TinyLfuPolicy {
+private:
+  enum class Segment { WINDOW, PROBATION, PROTECTED };
+
+  struct Node {
+    const K *key;
+    uint64_t hash;
+    Segment segment;
+  };
+  using NodeList = std::list<Node>;
+
+  // Shares of the resident entries, as in Caffeine's defaults.
+  static const size_t WINDOW_PERCENT = 1;
+  static const size_t PROTECTED_PERCENT = 80; // of the main region
+
+  NodeList window, probation, protected_; // most recent first
+  FrequencySketch sketch;
+
+  NodeList &list_for(Segment segment) {
+    switch (segment) {
+    case Segment::WINDOW:
+      return window;
+    case Segment::PROBATION:
+      return probation;
+    default:
+      return protected_;
+    }
+  }
+
+  size_t resident() const {
+    return window.size() + probation.size() + protected_.size();
+  }
+
+  void move_front(typename NodeList::iterator node, Segment to) {
+    list_for(to).splice(list_for(to).begin(), list_for(node->segment), node);
+    node->segment = to;
+  }
+
+  void demote_protected_overflow() {
+    size_t main = probation.size() + protected_.size();
+    while (!protected_.empty() &&
+           protected_.size() * 100 > main * PROTECTED_PERCENT) {
+      move_front(std::prev(protected_.end()), Segment::PROBATION);
+    }
+  }
+
+public:
+  using Handle = typename NodeList::iterator;
+
+  explicit TinyLfuPolicy(size_t expected_entries) : sketch(expected_entries) {}
+
+  Handle admit(const K *key, uint64_t hash) {
+    sketch.increment(hash);
+    window.push_front({key, hash, Segment::WINDOW});
+    return window.begin();
+  }
+
+  void access(Handle &handle, uint64_t hash) {
+    sketch.increment(hash);
+    switch (handle->segment) {
+    case Segment::WINDOW:
+    case Segment::PROTECTED:
+      move_front(handle, handle->segment);
+      break;
+    case Segment::PROBATION:
+      move_front(handle, Segment::PROTECTED);
+      demote_protected_overflow();
+      break;
+    }
+  }
+
+  void remove(Handle handle) { list_for(handle->segment).erase(handle); }
+
+  // Called after the new entry is admitted, so the newest window overflow
+  // is the candidate for admission to main.
+  const K *victim() {
+    size_t window_target =
+        std::max<size_t>(1, resident() * WINDOW_PERCENT / 100);
+    // Overflow that built up while the shard still had room (e.g. while it
+    // was filling) enters main without competing.
+    while (window.size() > window_target + 1) {
+      move_front(std::prev(window.end()), Segment::PROBATION);
+    }
+    if (probation.empty() && !protected_.empty()) {
+      move_front(std::prev(protected_.end()), Segment::PROBATION);
+    }
+    if (probation.empty()) {
+      return window.empty() ? nullptr : window.back().key;
+    }
+    if (window.size() <= window_target) {
+      return probation.back().key;
+    }
+
+    // The window's oldest entry competes with main's; ties go to the
+    // incumbent so a scan cannot churn the main region.
+    auto candidate = std::prev(window.end());
+    const Node &incumbent = probation.back();
+    if (sketch.frequency(candidate->hash) > sketch.frequency(incumbent.hash)) {
+      const K *evicted = incumbent.key;
+      move_front(candidate, Segment::PROBATION);
+      return evicted;
+    }
+    return candidate->key;
+  }
+
+  void clear() {
+    window.clear();
+    probation.clear();
+    protected_.clear();
+    sketch.clear();
+  }
+};
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef EXPORT_STREAM_HPP
+#define EXPORT_STREAM_HPP
+
+#include "database.hpp"
+#include "json_fast.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Streams the live cache_entries rows as one HTTP response body. A
+// producer thread reads them through a server-side cursor and formats each
+// batch into a pending buffer that the event loop swaps out whenever the
+// socket has drained, so the loop never waits on the database. The producer
+// stops while `max_buffered` bytes are pending, so a slow client throttles
+// the cursor instead of growing memory.
+class ExportStream {
+public:
+  enum class Format { JSON, NDJSON };
+  enum class Status { DATA, PENDING, DONE, FAILED };
+
+private:
+  DatabaseConnection *db;
+  Format format;
+  std::string head; // response head, sent with the first batch
+  std::string timestamp;
+  bool chunked;
+  size_t batch_rows;
+  size_t max_buffered;
+  std::function<void()> on_ready;
+
+  std::mutex mutex;
+  std::condition_variable space;
+  std::string pending;
+  bool started = false;
+  bool done = false;
+  bool failed = false;
+  bool cancelled = false;
+  std::string error;
+  std::thread producer;
+
+  void append_row(std::string &out, const pqxx::row &row) {
+    json_fast::append_object(out, {{"created_at", row[3].view()},
+                                   {"expiry", row[2].view()},
+                                   {"key", row[0].view()},
+                                   {"value", row[1].view()}});
+  }
+
+  // Hands `data` to the loop, framed as one chunk, waiting while too much
+  // is pending. Returns false once cancelled.
+  bool push(const std::string &data, bool last) {
+    std::unique_lock<std::mutex> lock(mutex);
+    space.wait(lock,
+               [this]() { return cancelled || pending.size() < max_buffered; });
+    if (cancelled) {
+      return false;
+    }
+    bool was_empty = pending.empty();
+    if (!started) {
+      pending += head;
+      started = true;
+    }
+    if (!data.empty()) {
+      if (chunked) {
+        char size[20];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", data.size());
+        pending.append(size, n);
+      }
+      pending += data;
+      if (chunked) {
+        pending += "\r\n";
+      }
+    }
+    if (last) {
+      if (chunked) {
+        pending += "0\r\n\r\n";
+      }
+      done = true;
+    }
+    if (was_empty || last) {
+      on_ready();
+    }
+    return true;
+  }
+
+  void run() {
+    std::string batch;
+    bool first = true;
+    try {
+      if (!db) {
+        throw std::runtime_error("Database connection not available");
+      }
+      if (format == Format::JSON) {
+        batch = "{\"entries\":[";
+      }
+      bool complete = true;
+      db->scan_live(batch_rows, [&](const pqxx::result &rows) {
+        for (const auto &row : rows) {
+          if (format == Format::JSON && !first) {
+            batch += ',';
+          }
+          first = false;
+          append_row(batch, row);
+          if (format == Format::NDJSON) {
+            batch += '\n';
+          }
+        }
+        complete = push(batch, false);
+        batch.clear();
+        return complete;
+      });
+      if (!complete) {
+        return;
+      }
+      if (format == Format::JSON) {
+        batch += "],\"timestamp\":";
+        json_fast::append_string(batch, timestamp);
+        batch += '}';
+      }
+      push(batch, true);
+    } catch (const std::exception &e) {
+      std::cerr << "Export failed: " << e.what() << std::endl;
+      std::lock_guard<std::mutex> lock(mutex);
+      error = e.what();
+      failed = true;
+      if (!cancelled) {
+        on_ready();
+      }
+    }
+  }
+
+public:
+  // `head` is the serialized response head, sent only once the first batch
+  // has been read, so a query that fails up front can still be answered
+  // with an error status. `on_ready` is called from the producer thread
+  // whenever take() has something new to return; never after cancel() has
+  // returned.
+  ExportStream(DatabaseConnection *db, Format format, std::string head,
+               std::string timestamp, bool chunked,
+               std::function<void()> on_ready, size_t batch_rows = 1000,
+               size_t max_buffered = 1024 * 1024)
+      : db(db), format(format), head(std::move(head)),
+        timestamp(std::move(timestamp)), chunked(chunked),
+        batch_rows(batch_rows), max_buffered(max_buffered),
+        on_ready(std::move(on_ready)), producer([this]() { run(); }) {}
+
+  // Blocks until the producer's current FETCH returns; cancel() first and
+  // destroy it elsewhere to avoid waiting.
+  ~ExportStream() {
+    cancel();
+    producer.join();
+  }
+
+  // Stops the producer at its next batch, without waiting for it.
+  void cancel() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancelled = true;
+    }
+    space.notify_all();
+  }
+
+  ExportStream(const ExportStream &) = delete;
+  ExportStream &operator=(const ExportStream &) = delete;
+
+  // Moves everything pending into `out`, which must be empty. DATA means
+  // more will follow; PENDING that nothing is ready yet. After DONE the
+  // body is complete. After FAILED the response is cut short, or was
+  // never started if has_started() is false.
+  Status take(std::string &out) {
+    Status status;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      out.swap(pending);
+      pending.clear();
+      if (failed) {
+        status = Status::FAILED;
+      } else if (done) {
+        status = Status::DONE;
+      } else {
+        status = out.empty() ? Status::PENDING : Status::DATA;
+      }
+    }
+    space.notify_one();
+    return status;
+  }
+
+  bool has_started() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return started;
+  }
+
+  std::string error_message() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return error;
+  }
+};
+
+#endif
@@ -0,0 +1,426 @@
+#ifndef HTTP_PARSER_HPP
+#define HTTP_PARSER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+struct HttpHeader {
+  std::string_view name;
+  std::string_view value;
+};
+
+// A parsed request. Every view points into the connection buffer and stays
+// valid until that buffer is modified.
+struct HttpRequest {
+  static const size_t MAX_HEADERS = 32;
+
+  std::string_view method;
+  std::string_view target;
+  std::string_view path;
+  std::string_view query;
+  std::string_view version;
+  HttpHeader headers[MAX_HEADERS];
+  size_t header_count = 0;
+  std::string_view body;
+  bool keep_alive = true;
+
+  static bool equals_ignore_case(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+      char x = a[i], y = b[i];
+      if (x >= 'A' && x <= 'Z')
+        x += 'a' - 'A';
+      if (y >= 'A' && y <= 'Z')
+        y += 'a' - 'A';
+      if (x != y)
+        return false;
+    }
+    return true;
+  }
+
+  std::string_view header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; i++) {
+      if (equals_ignore_case(headers[i].name, name)) {
+        return headers[i].value;
+      }
+    }
+    return {};
+  }
+};
+
+// Incremental HTTP/1.1 request parser. parse() is called with the unconsumed
+// front of the connection buffer each time more bytes arrive and resumes
+// where the previous call stopped. Chunked bodies are decoded in place so
+// the body is always one contiguous view; nothing is allocated.
+class HttpParser {
+public:
+  // HEADERS is only returned with report_headers set.
+  enum class Status { INCOMPLETE, COMPLETE, ERROR, HEADERS };
+
+private:
+  enum class Stage {
+    HEADERS,
+    HEADERS_REPORTED,
+    BODY,
+    CHUNK_SIZE,
+    CHUNK_DATA,
+    CHUNK_CRLF,
+    TRAILER
+  };
+
+  size_t max_header_bytes;
+  size_t max_body_bytes;
+  bool report_headers = false;
+  bool chunked = false;
+
+  Stage stage = Stage::HEADERS;
+  size_t scanned = 0;       // header bytes already searched for CRLFCRLF
+  size_t header_length = 0; // request line + headers + blank line
+  size_t content_length = 0;
+  size_t read_pos = 0;  // next raw byte of a chunked body
+  size_t write_pos = 0; // end of the decoded chunked body
+  size_t chunk_remaining = 0;
+  size_t consumed_bytes = 0;
+  int error = 0;
+  const char *head_base = nullptr; // buffer the header views point into
+
+  Status fail(int status) {
+    error = status;
+    return Status::ERROR;
+  }
+
+  static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+      s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+      s.remove_suffix(1);
+    return s;
+  }
+
+  static bool parse_decimal(std::string_view s, size_t &out) {
+    if (s.empty() || s.size() > 18) {
+      return false;
+    }
+    out = 0;
+    for (char c : s) {
+      if (c < '0' || c > '9')
+        return false;
+      out = out * 10 + (c - '0');
+    }
+    return true;
+  }
+
+  static bool contains_token(std::string_view list, std::string_view token) {
+    while (!list.empty()) {
+      size_t comma = list.find(',');
+      std::string_view item = trim(list.substr(0, comma));
+      if (HttpRequest::equals_ignore_case(item, token)) {
+        return true;
+      }
+      if (comma == std::string_view::npos)
+        break;
+      list.remove_prefix(comma + 1);
+    }
+    return false;
+  }
+
+  // The caller may move its buffer between calls (offsets are preserved),
+  // so views taken while parsing the headers are re-pointed once the body
+  // completes.
+  static void rebase(std::string_view &view, const char *from,
+                     const char *to) {
+    if (view.data()) {
+      view = std::string_view(to + (view.data() - from), view.size());
+    }
+  }
+
+  void rebase(HttpRequest &request, const char *data) {
+    if (head_base == data) {
+      return;
+    }
+    rebase(request.method, head_base, data);
+    rebase(request.target, head_base, data);
+    rebase(request.path, head_base, data);
+    rebase(request.query, head_base, data);
+    rebase(request.version, head_base, data);
+    for (size_t i = 0; i < request.header_count; i++) {
+      rebase(request.headers[i].name, head_base, data);
+      rebase(request.headers[i].value, head_base, data);
+    }
+    head_base = data;
+  }
+
+  Status parse_head(const char *data, HttpRequest &request) {
+    std::string_view head(data, header_length - 2);
+    head_base = data;
+
+    size_t line_end = head.find("\r\n");
+    std::string_view line = head.substr(0, line_end);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp1 == std::string_view::npos || sp2 == std::string_view::npos ||
+        sp1 == 0 || sp2 == sp1 + 1) {
+      return fail(400);
+    }
+    request.method = line.substr(0, sp1);
+    request.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    request.version = line.substr(sp2 + 1);
+    if (request.version != "HTTP/1.1" && request.version != "HTTP/1.0") {
+      return fail(400);
+    }
+    size_t question = request.target.find('?');
+    request.path = request.target.substr(0, question);
+    request.query = question == std::string_view::npos
+                        ? std::string_view()
+                        : request.target.substr(question + 1);
+
+    bool http10 = request.version == "HTTP/1.0";
+    bool has_length = false;
+    std::string_view connection;
+    request.header_count = 0;
+
+    size_t pos = line_end + 2;
+    while (pos < head.size()) {
+      size_t end = head.find("\r\n", pos);
+      if (end == std::string_view::npos)
+        end = head.size();
+      std::string_view field = head.substr(pos, end - pos);
+      pos = end + 2;
+
+      size_t colon = field.find(':');
+      if (colon == std::string_view::npos || colon == 0) {
+        return fail(400);
+      }
+      if (request.header_count == HttpRequest::MAX_HEADERS) {
+        return fail(431);
+      }
+      HttpHeader &header = request.headers[request.header_count++];
+      header.name = field.substr(0, colon);
+      header.value = trim(field.substr(colon + 1));
+
+      if (HttpRequest::equals_ignore_case(header.name, "Content-Length")) {
+        size_t length;
+        if (!parse_decimal(header.value, length) ||
+            (has_length && length != content_length)) {
+          return fail(400);
+        }
+        content_length = length;
+        has_length = true;
+      } else if (HttpRequest::equals_ignore_case(header.name,
+                                                 "Transfer-Encoding")) {
+        if (!contains_token(header.value, "chunked")) {
+          return fail(501);
+        }
+        chunked = true;
+      } else if (HttpRequest::equals_ignore_case(header.name, "Connection")) {
+        connection = header.value;
+      }
+    }
+
+    // Both framings at once is a request smuggling vector; refuse it.
+    if (has_length && chunked) {
+      return fail(400);
+    }
+
+    request.keep_alive = http10 ? contains_token(connection, "keep-alive")
+                                : !contains_token(connection, "close");
+    return Status::INCOMPLETE;
+  }
+
+  Status begin_body() {
+    if (content_length > max_body_bytes) {
+      return fail(413);
+    }
+    if (chunked) {
+      stage = Stage::CHUNK_SIZE;
+      read_pos = write_pos = header_length;
+    } else {
+      stage = Stage::BODY;
+    }
+    return Status::INCOMPLETE;
+  }
+
+  Status parse_chunks(char *data, size_t size, HttpRequest &request) {
+    while (true) {
+      switch (stage) {
+      case Stage::CHUNK_SIZE: {
+        const char *begin = data + read_pos;
+        const char *end =
+            static_cast<const char *>(memchr(begin, '\n', size - read_pos));
+        if (!end) {
+          return size - read_pos > 64 ? fail(400) : Status::INCOMPLETE;
+        }
+        size_t length = 0, digits = 0;
+        for (const char *p = begin; p < end; p++, digits++) {
+          char c = *p;
+          int value;
+          if (c >= '0' && c <= '9')
+            value = c - '0';
+          else if (c >= 'a' && c <= 'f')
+            value = c - 'a' + 10;
+          else if (c >= 'A' && c <= 'F')
+            value = c - 'A' + 10;
+          else
+            break; // chunk extension or CR
+          if (digits >= 15) {
+            return fail(413);
+          }
+          length = length * 16 + value;
+        }
+        if (digits == 0) {
+          return fail(400);
+        }
+        read_pos = end - data + 1;
+        if (length == 0) {
+          stage = Stage::TRAILER;
+          break;
+        }
+        if (write_pos - header_length + length > max_body_bytes) {
+          return fail(413);
+        }
+        chunk_remaining = length;
+        stage = Stage::CHUNK_DATA;
+        break;
+      }
+      case Stage::CHUNK_DATA: {
+        size_t available = std::min(chunk_remaining, size - read_pos);
+        if (available == 0) {
+          return Status::INCOMPLETE;
+        }
+        if (write_pos != read_pos) {
+          memmove(data + write_pos, data + read_pos, available);
+        }
+        read_pos += available;
+        write_pos += available;
+        chunk_remaining -= available;
+        if (chunk_remaining == 0) {
+          stage = Stage::CHUNK_CRLF;
+        }
+        break;
+      }
+      case Stage::CHUNK_CRLF:
+        if (size - read_pos < 2) {
+          return Status::INCOMPLETE;
+        }
+        if (data[read_pos] != '\r' || data[read_pos + 1] != '\n') {
+          return fail(400);
+        }
+        read_pos += 2;
+        stage = Stage::CHUNK_SIZE;
+        break;
+      case Stage::TRAILER: {
+        // Trailer fields are skipped up to the terminating empty line.
+        const char *begin = data + read_pos;
+        const char *end =
+            static_cast<const char *>(memchr(begin, '\n', size - read_pos));
+        if (!end) {
+          return size - read_pos > 8192 ? fail(431) : Status::INCOMPLETE;
+        }
+        size_t line_length = end - begin;
+        read_pos = end - data + 1;
+        if (line_length == 0 || (line_length == 1 && *begin == '\r')) {
+          rebase(request, data);
+          request.body = std::string_view(data + header_length,
+                                          write_pos - header_length);
+          consumed_bytes = read_pos;
+          return Status::COMPLETE;
+        }
+        break;
+      }
+      default:
+        return fail(500);
+      }
+    }
+  }
+
+public:
+  explicit HttpParser(size_t max_header_bytes = 8192,
+                      size_t max_body_bytes = 1024 * 1024)
+      : max_header_bytes(max_header_bytes), max_body_bytes(max_body_bytes) {}
+
+  // Parses the request at the front of `data`. Returns INCOMPLETE until the
+  // whole request has arrived; after COMPLETE, consumed() bytes belong to it
+  // and reset() must be called before parsing the next one. With
+  // report_headers set, HEADERS is returned first, once the head is parsed
+  // and before the body size is checked; the caller then either calls
+  // parse() again or reads the body itself (see header_bytes()).
+  Status parse(char *data, size_t size, HttpRequest &request) {
+    if (error) {
+      return Status::ERROR;
+    }
+
+    if (stage == Stage::HEADERS) {
+      size_t from = scanned > 3 ? scanned - 3 : 0;
+      std::string_view view(data, size);
+      size_t end = view.find("\r\n\r\n", from);
+      if (end == std::string_view::npos) {
+        scanned = size;
+        return size > max_header_bytes ? fail(431) : Status::INCOMPLETE;
+      }
+      header_length = end + 4;
+      if (header_length > max_header_bytes) {
+        return fail(431);
+      }
+      if (parse_head(data, request) == Status::ERROR) {
+        return Status::ERROR;
+      }
+      if (report_headers) {
+        stage = Stage::HEADERS_REPORTED;
+        return Status::HEADERS;
+      }
+    }
+    if (stage == Stage::HEADERS || stage == Stage::HEADERS_REPORTED) {
+      if (begin_body() == Status::ERROR) {
+        return Status::ERROR;
+      }
+    }
+
+    if (stage == Stage::BODY) {
+      if (size < header_length + content_length) {
+        return Status::INCOMPLETE;
+      }
+      rebase(request, data);
+      request.body = std::string_view(data + header_length, content_length);
+      consumed_bytes = header_length + content_length;
+      return Status::COMPLETE;
+    }
+
+    return parse_chunks(data, size, request);
+  }
+
+  size_t consumed() const { return consumed_bytes; }
+
+  // Stop at HEADERS for every request, so the caller can stream bodies of
+  // chosen routes instead of buffering them whole.
+  void set_report_headers(bool report) { report_headers = report; }
+
+  // After HEADERS: the bytes of request line and headers, and how the body
+  // that follows them is framed.
+  size_t header_bytes() const { return header_length; }
+  size_t body_length() const { return content_length; }
+  bool chunked_body() const { return chunked; }
+
+  // Total size of the current request once its headers announced a
+  // Content-Length, so the caller can size its buffer up front; 0 otherwise.
+  size_t bytes_needed() const {
+    return stage == Stage::BODY ? header_length + content_length : 0;
+  }
+
+  // HTTP status to answer a malformed request with.
+  int error_status() const { return error; }
+
+  void reset() {
+    stage = Stage::HEADERS;
+    scanned = header_length = content_length = 0;
+    read_pos = write_pos = chunk_remaining = consumed_bytes = 0;
+    chunked = false;
+    error = 0;
+    head_base = nullptr;
+  }
+};
+
+#endif
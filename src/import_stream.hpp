@@ -0,0 +1,286 @@
+#ifndef IMPORT_STREAM_HPP
+#define IMPORT_STREAM_HPP
+
+#include "cache.hpp"
+#include "database.hpp"
+#include "json_fast.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Loads an NDJSON request body, one {key, value, expiry, created_at} object
+// per line as GET /api/export?format=ndjson writes them. The event loop
+// feeds body bytes as they arrive; a worker thread splits them into lines
+// and writes every `batch_rows` rows to the database with
+// DatabaseConnection::import_rows(), then loads the merged rows into the
+// cache. feed() takes no more than `max_buffered` unprocessed bytes, so
+// the loop stops reading the socket while the database catches up. A line
+// longer than `max_line_bytes` fails the import, so a body without
+// newlines is never buffered whole.
+class ImportStream {
+public:
+  struct Result {
+    size_t imported = 0;
+    size_t expired = 0; // already past their expiry, skipped
+    size_t invalid = 0; // lines that are not an entry object
+    std::string error;  // set if a batch failed; later lines are unread
+  };
+
+  using Cache = LRUCache<std::string, std::string>;
+
+private:
+  Cache &cache;
+  DatabaseConnection *db;
+  CacheMetrics *metrics;
+  bool warm;
+  size_t max_line_bytes;
+  size_t batch_rows;
+  size_t max_buffered;
+  std::function<void()> on_ready;
+
+  std::mutex mutex;
+  std::condition_variable input_cv;
+  std::string input;
+  bool input_done = false;
+  bool want_space = false;
+  bool cancelled = false;
+  bool finished = false;
+  Result result;
+
+  // Worker state.
+  std::vector<ImportRow> batch;
+  std::unordered_map<std::string_view, size_t> batch_index; // into batch
+  std::string scratch;
+  json_fast::Parser parser;
+
+  std::thread worker;
+
+  bool parse_fast(std::string_view line, ImportRow &row) {
+    bool has_key = false, has_value = false, has_expiry = false;
+    row.created_at.clear();
+    bool parsed = parser.parse_object(line, scratch, [&](const std::string &name) {
+      if (name == "key") {
+        return !std::exchange(has_key, true) && parser.string(row.key);
+      }
+      if (name == "value") {
+        return !std::exchange(has_value, true) && parser.string(row.value);
+      }
+      if (name == "expiry") {
+        return !std::exchange(has_expiry, true) && parser.string(row.expiry);
+      }
+      if (name == "created_at") {
+        return parser.string(row.created_at);
+      }
+      return parser.skip(scratch);
+    });
+    return parsed && has_key && has_value && has_expiry;
+  }
+
+  // Falls back to nlohmann::json for lines the fast parser declines, such
+  // as values holding raw UTF-8.
+  static bool parse_slow(std::string_view line, ImportRow &row) {
+    nlohmann::json object =
+        nlohmann::json::parse(line.begin(), line.end(), nullptr, false);
+    if (!object.is_object() || !object.contains("key") ||
+        !object.contains("value") || !object.contains("expiry") ||
+        !object["key"].is_string() || !object["value"].is_string() ||
+        !object["expiry"].is_string()) {
+      return false;
+    }
+    row.key = object["key"].get<std::string>();
+    row.value = object["value"].get<std::string>();
+    row.expiry = object["expiry"].get<std::string>();
+    auto created_at = object.find("created_at");
+    row.created_at = created_at != object.end() && created_at->is_string()
+                         ? created_at->get<std::string>()
+                         : std::string();
+    return true;
+  }
+
+  void add_line(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+      line.remove_suffix(1);
+    }
+    if (line.find_first_not_of(" \t") == std::string_view::npos) {
+      return;
+    }
+    ImportRow row;
+    if (!parse_fast(line, row) && !parse_slow(line, row)) {
+      result.invalid++;
+      metrics->record_import_invalid();
+      return;
+    }
+    // A key repeated within a batch keeps its last value. The stored key
+    // stays put, since batch_index views it.
+    auto it = batch_index.find(row.key);
+    if (it != batch_index.end()) {
+      ImportRow &existing = batch[it->second];
+      existing.value = std::move(row.value);
+      existing.expiry = std::move(row.expiry);
+      existing.created_at = std::move(row.created_at);
+      return;
+    }
+    batch.push_back(std::move(row));
+    batch_index.emplace(batch.back().key, batch.size() - 1);
+    if (batch.size() == batch_rows) {
+      flush_batch();
+    }
+  }
+
+  void flush_batch() {
+    if (batch.empty()) {
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto merged = db->import_rows(batch);
+    if (warm) {
+      std::vector<Cache::Entry> entries;
+      entries.reserve(merged.size());
+      for (auto &[key, ttl] : merged) {
+        ImportRow &row = batch[batch_index.at(key)];
+        entries.push_back({std::move(key), std::move(row.value), ttl});
+      }
+      cache.load_many(entries);
+    }
+    result.imported += merged.size();
+    result.expired += batch.size() - merged.size();
+    metrics->observe_import_batch(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count(),
+        merged.size(), batch.size() - merged.size());
+    batch_index.clear();
+    batch.clear(); // capacity stays at batch_rows, so keys never move
+  }
+
+  void run() {
+    std::string chunk;
+    std::string lines; // unfinished last line, then the next chunk
+    size_t scanned = 0; // bytes of `lines` known to hold no newline
+    try {
+      if (!db) {
+        throw std::runtime_error("Database connection not available");
+      }
+      bool last = false;
+      while (!last) {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          input_cv.wait(lock, [this]() {
+            return cancelled || input_done || !input.empty();
+          });
+          if (cancelled) {
+            return;
+          }
+          chunk.clear();
+          chunk.swap(input);
+          last = input_done;
+          if (std::exchange(want_space, false)) {
+            on_ready();
+          }
+        }
+        metrics->record_import_bytes(chunk.size());
+
+        lines += chunk;
+        size_t begin = 0, end;
+        while ((end = lines.find('\n', scanned)) != std::string::npos) {
+          add_line(std::string_view(lines).substr(begin, end - begin));
+          begin = scanned = end + 1;
+        }
+        lines.erase(0, begin);
+        scanned = lines.size();
+        if (lines.size() > max_line_bytes) {
+          throw std::runtime_error("Line longer than " +
+                                   std::to_string(max_line_bytes) + " bytes");
+        }
+      }
+      add_line(lines);
+      flush_batch();
+    } catch (const std::exception &e) {
+      std::cerr << "Import failed: " << e.what() << std::endl;
+      result.error = e.what();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    finished = true;
+    if (!cancelled) {
+      on_ready();
+    }
+  }
+
+public:
+  // `on_ready` is called from the worker when feed() has room again after
+  // refusing bytes, and once the import has finished; never after cancel()
+  // has returned.
+  ImportStream(Cache &cache, bool warm, std::function<void()> on_ready,
+               size_t max_line_bytes, size_t batch_rows = 5000,
+               size_t max_buffered = 4 * 1024 * 1024)
+      : cache(cache), db(cache.get_db()), metrics(cache.get_metrics()),
+        warm(warm), max_line_bytes(max_line_bytes), batch_rows(batch_rows),
+        max_buffered(max_buffered),
+        on_ready(std::move(on_ready)) {
+    batch.reserve(batch_rows);
+    metrics->record_import_started();
+    worker = std::thread([this]() { run(); });
+  }
+
+  // Blocks until the worker has finished its current batch; cancel() first
+  // and destroy it elsewhere to avoid waiting.
+  ~ImportStream() {
+    cancel();
+    worker.join();
+    metrics->record_import_finished();
+  }
+
+  ImportStream(const ImportStream &) = delete;
+  ImportStream &operator=(const ImportStream &) = delete;
+
+  // Queues up to `size` body bytes and returns how many were taken; fewer
+  // means the buffer is full and on_ready will be called once it drains.
+  size_t feed(const char *data, size_t size) {
+    size_t taken;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      size_t room = input.size() < max_buffered ? max_buffered - input.size()
+                                                : 0;
+      taken = std::min(size, room);
+      input.append(data, taken);
+      if (taken < size) {
+        want_space = true;
+      }
+    }
+    input_cv.notify_one();
+    return taken;
+  }
+
+  // Stops the import after the batch in progress, without waiting for it.
+  void cancel() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancelled = true;
+    }
+    input_cv.notify_all();
+  }
+
+  // Marks the end of the body.
+  void finish_input() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      input_done = true;
+    }
+    input_cv.notify_one();
+  }
+
+  bool done() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return finished;
+  }
+
+  // Valid once done().
+  const Result &outcome() const { return result; }
+};
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef JSON_FAST_HPP
+#define JSON_FAST_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// DOM-free JSON for the cache's fixed-shape requests and responses. The
+// writer escapes straight into the caller's buffer; the parser reads flat
+// objects such as the {key, value, ttl} body and declines anything else,
+// leaving it to nlohmann::json.
+namespace json_fast {
+
+// One member of a flat object: a string, or an integer when `is_number`.
+struct Field {
+  std::string_view name;
+  std::string_view text;
+  int64_t number = 0;
+  bool is_number = false;
+
+  Field(std::string_view name, std::string_view text)
+      : name(name), text(text) {}
+  Field(std::string_view name, int64_t number)
+      : name(name), number(number), is_number(true) {}
+};
+
+inline bool needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Length of `s` once quoted and escaped, matching append_string().
+inline size_t string_size(std::string_view s) {
+  size_t size = s.size() + 2;
+  for (unsigned char c : s) {
+    if (needs_escape(c)) {
+      switch (c) {
+      case '"':
+      case '\\':
+      case '\b':
+      case '\f':
+      case '\n':
+      case '\r':
+      case '\t':
+        size += 1;
+        break;
+      default:
+        size += 5; // \u00XX
+      }
+    }
+  }
+  return size;
+}
+
+// Appends `s` quoted, escaping as nlohmann::json::dump() does. Bytes at or
+// above 0x80 are copied as they are.
+inline void append_string(std::string &out, std::string_view s) {
+  static const char HEX[] = "0123456789abcdef";
+  out += '"';
+  size_t run = 0;
+  for (size_t i = 0; i < s.size(); i++) {
+    unsigned char c = s[i];
+    if (!needs_escape(c)) {
+      continue;
+    }
+    out.append(s.data() + run, i - run);
+    run = i + 1;
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\b':
+      out += "\\b";
+      break;
+    case '\f':
+      out += "\\f";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      out += "\\u00";
+      out += HEX[c >> 4];
+      out += HEX[c & 0xF];
+    }
+  }
+  out.append(s.data() + run, s.size() - run);
+  out += '"';
+}
+
+inline size_t object_size(std::initializer_list<Field> fields) {
+  size_t size = 2 + (fields.size() > 0 ? fields.size() - 1 : 0);
+  for (const Field &field : fields) {
+    size += string_size(field.name) + 1;
+    size += field.is_number ? std::to_string(field.number).size()
+                            : string_size(field.text);
+  }
+  return size;
+}
+
+// Appends the fields as one compact object, in the order given. Callers
+// list them alphabetically to match nlohmann::json's output byte for byte.
+inline void append_object(std::string &out,
+                          std::initializer_list<Field> fields) {
+  out += '{';
+  bool first = true;
+  for (const Field &field : fields) {
+    if (!first)
+      out += ',';
+    first = false;
+    append_string(out, field.name);
+    out += ':';
+    if (field.is_number) {
+      out += std::to_string(field.number);
+    } else {
+      append_string(out, field.text);
+    }
+  }
+  out += '}';
+}
+
+// Body of POST /api/cached. `key` and `value` are unescaped into the
+// caller's strings, which keep their capacity between requests.
+struct CacheEntryRequest {
+  std::string key;
+  std::string value;
+  int64_t ttl = 300;
+};
+
+// Reads flat objects whose members are strings, integers, booleans or
+// null. Nesting, fractions and raw non-ASCII bytes are declined.
+class Parser {
+private:
+  const char *p;
+  const char *end;
+
+  void skip_space() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+      p++;
+  }
+
+  static int hex_digit(char c) {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
+  }
+
+  bool read_hex4(unsigned &code) {
+    if (end - p < 4)
+      return false;
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+      int digit = hex_digit(p[i]);
+      if (digit < 0)
+        return false;
+      code = code * 16 + digit;
+    }
+    p += 4;
+    return true;
+  }
+
+  static void append_utf8(std::string &out, unsigned code) {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    } else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  // Reads a string into `out`. Raw non-ASCII bytes are declined rather
+  // than UTF-8 validated here.
+  bool read_string(std::string &out) {
+    if (p == end || *p != '"')
+      return false;
+    p++;
+    out.clear();
+    const char *run = p;
+    while (p < end) {
+      unsigned char c = *p;
+      if (c == '"') {
+        out.append(run, p - run);
+        p++;
+        return true;
+      }
+      if (c < 0x20 || c >= 0x80)
+        return false;
+      if (c != '\\') {
+        p++;
+        continue;
+      }
+      out.append(run, p - run);
+      if (++p == end)
+        return false;
+      char escape = *p++;
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        out += escape;
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'n':
+        out += '\n';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'u': {
+        unsigned code;
+        if (!read_hex4(code))
+          return false;
+        if (code >= 0xD800 && code <= 0xDBFF) {
+          unsigned low;
+          if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+            return false;
+          p += 2;
+          if (!read_hex4(low) || low < 0xDC00 || low > 0xDFFF)
+            return false;
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        } else if (code >= 0xDC00 && code <= 0xDFFF) {
+          return false;
+        }
+        append_utf8(out, code);
+        break;
+      }
+      default:
+        return false;
+      }
+      run = p;
+    }
+    return false;
+  }
+
+  // Integers only; fractions and exponents are declined.
+  bool read_integer(int64_t &out) {
+    bool negative = p < end && *p == '-';
+    if (negative)
+      p++;
+    const char *start = p;
+    int64_t value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (value > (INT64_MAX - 9) / 10)
+        return false;
+      value = value * 10 + (*p++ - '0');
+    }
+    if (p == start || (*start == '0' && p - start > 1))
+      return false;
+    if (p < end && (*p == '.' || *p == 'e' || *p == 'E'))
+      return false;
+    out = negative ? -value : value;
+    return true;
+  }
+
+  bool skip_literal(std::string_view literal) {
+    if (static_cast<size_t>(end - p) < literal.size() ||
+        std::string_view(p, literal.size()) != literal)
+      return false;
+    p += literal.size();
+    return true;
+  }
+
+  // Skips a member the endpoint ignores; nested values are declined.
+  bool skip_scalar(std::string &scratch) {
+    if (p == end)
+      return false;
+    int64_t number;
+    switch (*p) {
+    case '"':
+      return read_string(scratch);
+    case 't':
+      return skip_literal("true");
+    case 'f':
+      return skip_literal("false");
+    case 'n':
+      return skip_literal("null");
+    default:
+      return read_integer(number);
+    }
+  }
+
+public:
+  // Walks the object in `body`, calling member(name) with the parser at
+  // each member's value. The callback consumes the value with string(),
+  // integer() or skip() and returns false to decline the whole object.
+  // `name` is reused between members.
+  template <typename Fn>
+  bool parse_object(std::string_view body, std::string &name, Fn &&member) {
+    p = body.data();
+    end = body.data() + body.size();
+    skip_space();
+    if (p == end || *p++ != '{')
+      return false;
+    skip_space();
+    if (p < end && *p == '}') {
+      p++;
+    } else {
+      while (true) {
+        skip_space();
+        if (!read_string(name))
+          return false;
+        skip_space();
+        if (p == end || *p++ != ':')
+          return false;
+        skip_space();
+        if (!member(name))
+          return false;
+        skip_space();
+        if (p == end)
+          return false;
+        if (*p == ',') {
+          p++;
+          continue;
+        }
+        if (*p++ != '}')
+          return false;
+        break;
+      }
+    }
+    skip_space();
+    return p == end;
+  }
+
+  bool string(std::string &out) { return read_string(out); }
+  bool integer(int64_t &out) { return read_integer(out); }
+  // Skips a member the caller ignores, reading it into `scratch`.
+  bool skip(std::string &scratch) { return skip_scalar(scratch); }
+
+  // Fills `request` from `body`. Returns false unless the body has string
+  // "key" and "value", an optional integer "ttl" and otherwise only scalar
+  // members, each name at most once; the caller then falls back to the
+  // general parser, which also produces the error reply.
+  bool parse_entry(std::string_view body, CacheEntryRequest &request,
+                   std::string &scratch) {
+    bool has_key = false, has_value = false, has_ttl = false;
+    request.ttl = 300;
+    bool parsed = parse_object(body, scratch, [&](const std::string &name) {
+      if (name == "key") {
+        return !std::exchange(has_key, true) && read_string(request.key);
+      }
+      if (name == "value") {
+        return !std::exchange(has_value, true) && read_string(request.value);
+      }
+      if (name == "ttl") {
+        return !std::exchange(has_ttl, true) && read_integer(request.ttl) &&
+               request.ttl <= INT32_MAX && request.ttl >= INT32_MIN;
+      }
+      return skip_scalar(scratch);
+    });
+    return parsed && has_key && has_value;
+  }
+};
+
+} // namespace json_fast
+
+#endif
@@ -0,0 +1,193 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include "striped_counter.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A duration histogram cheap enough for the request path and the shard
+// locks. prometheus::Histogram takes a mutex on every Observe(); here each
+// thread counts into its own cache-line-aligned stripe with relaxed
+// atomics, and the stripes are only summed when Prometheus scrapes.
+class LatencyHistogram {
+public:
+  static constexpr size_t MAX_BUCKETS = 15; // finite ones; +Inf is implicit
+
+private:
+  struct alignas(64) Stripe {
+    std::array<std::atomic<uint64_t>, MAX_BUCKETS + 1> counts{};
+    std::atomic<uint64_t> sum_ns{0};
+  };
+
+  std::vector<double> bounds;       // upper bounds in seconds, ascending
+  std::vector<int64_t> bounds_ns;   // the same, for observe()
+  std::unique_ptr<Stripe[]> stripes;
+
+public:
+  explicit LatencyHistogram(const std::vector<double> &bounds)
+      : bounds(bounds.begin(),
+               bounds.begin() + std::min(bounds.size(), MAX_BUCKETS)),
+        stripes(new Stripe[METRIC_STRIPES]()) {
+    for (double bound : this->bounds) {
+      bounds_ns.push_back(std::llround(bound * 1e9));
+    }
+  }
+
+  void observe(std::chrono::steady_clock::duration elapsed) {
+    int64_t ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    size_t bucket = 0;
+    while (bucket < bounds_ns.size() && ns > bounds_ns[bucket]) {
+      bucket++;
+    }
+    Stripe &stripe = stripes[metric_stripe()];
+    stripe.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    if (ns > 0) {
+      stripe.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+  }
+
+  // Totals across stripes. Observations racing the scrape may show up in
+  // the count a scrape before their sum, which Prometheus tolerates.
+  prometheus::ClientMetric::Histogram collect() const {
+    std::array<uint64_t, MAX_BUCKETS + 1> counts{};
+    uint64_t sum_ns = 0;
+    for (size_t s = 0; s < METRIC_STRIPES; s++) {
+      for (size_t b = 0; b <= bounds.size(); b++) {
+        counts[b] += stripes[s].counts[b].load(std::memory_order_relaxed);
+      }
+      sum_ns += stripes[s].sum_ns.load(std::memory_order_relaxed);
+    }
+
+    prometheus::ClientMetric::Histogram histogram;
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b <= bounds.size(); b++) {
+      cumulative += counts[b];
+      prometheus::ClientMetric::Bucket bucket;
+      bucket.cumulative_count = cumulative;
+      bucket.upper_bound = b < bounds.size()
+                               ? bounds[b]
+                               : std::numeric_limits<double>::infinity();
+      histogram.bucket.push_back(bucket);
+    }
+    histogram.sample_count = cumulative;
+    histogram.sample_sum = static_cast<double>(sum_ns) / 1e9;
+    return histogram;
+  }
+};
+
+// A labelled set of LatencyHistograms exposed as one Prometheus histogram.
+// Register it with Exposer::RegisterCollectable().
+class LatencyFamily : public prometheus::Collectable {
+private:
+  std::string name;
+  std::string help;
+  std::vector<double> bounds;
+  mutable std::mutex mutex; // guards `series`; observe() never takes it
+  std::map<prometheus::Labels, std::unique_ptr<LatencyHistogram>> series;
+
+public:
+  LatencyFamily(std::string name, std::string help, std::vector<double> bounds)
+      : name(std::move(name)), help(std::move(help)),
+        bounds(std::move(bounds)) {}
+
+  // The series for `labels`, created on first use. References stay valid
+  // for the family's lifetime; callers keep them instead of calling this
+  // per observation.
+  LatencyHistogram &add(const prometheus::Labels &labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &histogram = series[labels];
+    if (!histogram) {
+      histogram = std::make_unique<LatencyHistogram>(bounds);
+    }
+    return *histogram;
+  }
+
+  std::vector<prometheus::MetricFamily> Collect() const override {
+    prometheus::MetricFamily family;
+    family.name = name;
+    family.help = help;
+    family.type = prometheus::MetricType::Histogram;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &[labels, histogram] : series) {
+      prometheus::ClientMetric metric;
+      for (const auto &[label, value] : labels) {
+        metric.label.push_back({label, value});
+      }
+      metric.histogram = histogram->collect();
+      family.metric.push_back(std::move(metric));
+    }
+    return {family};
+  }
+};
+
+// A mutex that reports how long lockers waited for it and how long they
+// held it. An uncontended lock() costs no clock reads for the wait, and
+// hold times are sampled on one acquisition in HOLD_SAMPLE per thread, so
+// the timing stays small next to the critical sections it measures.
+class TimedMutex {
+public:
+  static constexpr uint32_t HOLD_SAMPLE = 16;
+
+private:
+  std::mutex mutex;
+  LatencyHistogram *wait = nullptr;
+  LatencyHistogram *hold = nullptr;
+  // Set by the holder when this acquisition's hold is sampled.
+  std::chrono::steady_clock::time_point acquired{};
+
+  void on_acquired() {
+    thread_local uint32_t acquisitions = 0;
+    if (hold && ++acquisitions % HOLD_SAMPLE == 0) {
+      acquired = std::chrono::steady_clock::now();
+    }
+  }
+
+public:
+  // Histograms to record into; unset, the mutex only locks.
+  void observe(LatencyHistogram *wait, LatencyHistogram *hold) {
+    this->wait = wait;
+    this->hold = hold;
+  }
+
+  void lock() {
+    if (mutex.try_lock()) {
+      if (wait) {
+        wait->observe(std::chrono::steady_clock::duration::zero());
+      }
+    } else {
+      auto start = std::chrono::steady_clock::now();
+      mutex.lock();
+      if (wait) {
+        wait->observe(std::chrono::steady_clock::now() - start);
+      }
+    }
+    on_acquired();
+  }
+
+  bool try_lock() {
+    if (!mutex.try_lock()) {
+      return false;
+    }
+    on_acquired();
+    return true;
+  }
+
+  void unlock() {
+    if (acquired != std::chrono::steady_clock::time_point{}) {
+      hold->observe(std::chrono::steady_clock::now() - acquired);
+      acquired = {};
+    }
+    mutex.unlock();
+  }
+};
+
+#endif
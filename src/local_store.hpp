@@ -0,0 +1,721 @@
+#ifndef LOCAL_STORE_HPP
+#define LOCAL_STORE_HPP
+
+#include "storage.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class FsyncPolicy {
+  // Every write is synced to disk before it is acknowledged.
+  ALWAYS,
+  // The background thread syncs the log once a second, so a crash loses at
+  // most that window.
+  EVERYSEC,
+  // Flushing is left to the OS.
+  NEVER,
+};
+
+struct LocalStoreConfig {
+  // Directory holding the snapshot and log files; created if missing.
+  std::string dir = "store";
+  FsyncPolicy fsync = FsyncPolicy::EVERYSEC;
+  // Log size that triggers a snapshot, after which the log starts over.
+  size_t compact_bytes = 64 * 1024 * 1024;
+  // Longest a non-empty log goes without a snapshot.
+  std::chrono::seconds snapshot_interval = std::chrono::seconds(300);
+
+  static LocalStoreConfig from_env() {
+    LocalStoreConfig config;
+    if (const char *dir = std::getenv("CACHE_STORAGE_DIR")) {
+      config.dir = dir;
+    }
+    if (const char *fsync = std::getenv("CACHE_STORAGE_FSYNC")) {
+      if (strcmp(fsync, "always") == 0)
+        config.fsync = FsyncPolicy::ALWAYS;
+      else if (strcmp(fsync, "never") == 0)
+        config.fsync = FsyncPolicy::NEVER;
+      else
+        config.fsync = FsyncPolicy::EVERYSEC;
+    }
+    if (const char *bytes = std::getenv("CACHE_STORAGE_COMPACT_BYTES")) {
+      config.compact_bytes = std::max(1L, std::strtol(bytes, nullptr, 10));
+    }
+    if (const char *interval = std::getenv("CACHE_STORAGE_SNAPSHOT_SECS")) {
+      config.snapshot_interval = std::chrono::seconds(
+          std::max(1L, std::strtol(interval, nullptr, 10)));
+    }
+    return config;
+  }
+};
+
+// Embedded persistence for nodes that only need to survive restarts. Every
+// live entry is held in an in-memory index; disk holds a snapshot of the
+// index plus an append-only log of the writes made since. For generation N
+// the directory holds:
+//
+//   snapshot-N.dat  every live entry at the moment wal-N.log was started
+//   wal-N.log       checksummed put and delete records since then
+//
+// A background thread moves to generation N+1 once the log outgrows
+// compact_bytes or snapshot_interval passes: writes switch to wal-N+1.log
+// while the index as of the switch is written to snapshot-N+1.dat, and
+// generation N's files are deleted once it is complete. Recovery maps the
+// newest complete snapshot and replays the logs from its generation on.
+// Values from a snapshot are read straight from the mapping rather than
+// copied to the heap, and compaction moves logged values there too.
+// Files are in the host's byte order.
+class LocalStore : public Storage {
+private:
+  static constexpr char SNAPSHOT_MAGIC[8] = {'C', 'P', 'P', 'S',
+                                             'N', 'A', 'P', '1'};
+  static constexpr char SNAPSHOT_END[8] = {'C', 'P', 'P', 'S',
+                                           'E', 'N', 'D', '1'};
+  enum Op : uint8_t { PUT = 1, DELETE = 2 };
+  // Log record: crc32 of the rest, op, key length, value length, expiry,
+  // then the key and value bytes.
+  static constexpr size_t LOG_HEADER = 4 + 1 + 4 + 4 + 8;
+  // Snapshot record: key length, value length, expiry, key, value.
+  static constexpr size_t SNAPSHOT_HEADER = 4 + 4 + 8;
+  static constexpr size_t WRITE_BUFFER = 1024 * 1024;
+  static constexpr size_t SKIPPED = SIZE_MAX;
+
+  // A read-only mapping of a whole file.
+  struct Mapping {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    explicit Mapping(const std::string &path) {
+      int fd = open(path.c_str(), O_RDONLY);
+      struct stat st;
+      if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0)
+          close(fd);
+        throw std::runtime_error("Cannot open " + path + ": " +
+                                 strerror(errno));
+      }
+      size = st.st_size;
+      if (size > 0) {
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+          close(fd);
+          throw std::runtime_error("Cannot map " + path + ": " +
+                                   strerror(errno));
+        }
+        data = static_cast<const char *>(p);
+      }
+      close(fd);
+    }
+    ~Mapping() {
+      if (data) {
+        munmap(const_cast<char *>(data), size);
+      }
+    }
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+  };
+
+  struct Value {
+    std::string_view data; // into `owned`, or into the snapshot mapping
+    std::shared_ptr<const std::string> owned;
+    int64_t expiry; // milliseconds since the epoch
+  };
+
+  LocalStoreConfig config;
+  std::filesystem::path dir;
+
+  std::shared_mutex mutex; // guards the index and the log
+  std::unordered_map<std::string, Value> index;
+  std::shared_ptr<Mapping> snapshot;
+  uint64_t generation = 1;
+  int log_fd = -1;
+  size_t log_bytes = 0;
+  std::string record; // encoding buffer for the log
+  std::chrono::steady_clock::time_point last_snapshot;
+  std::atomic<bool> unsynced{false};
+
+  std::mutex compact_mutex; // one compaction at a time
+
+  std::mutex worker_mutex;
+  std::condition_variable worker_cv;
+  bool running = true;
+  std::thread worker;
+
+  static uint32_t crc32(const char *data, size_t size) {
+    static const std::array<uint32_t, 256> table = []() {
+      std::array<uint32_t, 256> t{};
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+          c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        t[i] = c;
+      }
+      return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+      crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^
+            (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+  }
+
+  template <typename T> static void append_raw(std::string &out, T value) {
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  template <typename T> static T read_raw(const char *p) {
+    T value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  static int64_t to_millis(std::chrono::system_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               t.time_since_epoch())
+        .count();
+  }
+
+  static int64_t now_millis() {
+    return to_millis(std::chrono::system_clock::now());
+  }
+
+  static void sync_file(int fd) {
+#ifdef __APPLE__
+    fsync(fd);
+#else
+    fdatasync(fd);
+#endif
+  }
+
+  static bool write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+      ssize_t n = write(fd, data, size);
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  static void append_record(std::string &out, Op op, std::string_view key,
+                            std::string_view value, int64_t expiry) {
+    size_t start = out.size();
+    append_raw<uint32_t>(out, 0);
+    out += static_cast<char>(op);
+    append_raw<uint32_t>(out, key.size());
+    append_raw<uint32_t>(out, value.size());
+    append_raw<int64_t>(out, expiry);
+    out += key;
+    out += value;
+    uint32_t crc = crc32(out.data() + start + 4, out.size() - start - 4);
+    memcpy(&out[start], &crc, sizeof(crc));
+  }
+
+  std::string file_path(const char *prefix, uint64_t gen,
+                        const char *suffix) const {
+    return (dir / (prefix + std::to_string(gen) + suffix)).string();
+  }
+  std::string snapshot_path(uint64_t gen) const {
+    return file_path("snapshot-", gen, ".dat");
+  }
+  std::string log_path(uint64_t gen) const {
+    return file_path("wal-", gen, ".log");
+  }
+
+  // Reads the generation out of names like "wal-12.log".
+  static bool parse_name(const std::string &name, std::string_view prefix,
+                         std::string_view suffix, uint64_t &gen) {
+    if (name.size() <= prefix.size() + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+      return false;
+    std::string digits =
+        name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    if (digits.find_first_not_of("0123456789") != std::string::npos)
+      return false;
+    gen = std::stoull(digits);
+    return true;
+  }
+
+  void sync_dir() {
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      fsync(fd);
+      close(fd);
+    }
+  }
+
+  int open_log(uint64_t gen) {
+    int fd = open(log_path(gen).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      std::cerr << "Local store cannot open " << log_path(gen) << ": "
+                << strerror(errno) << std::endl;
+    }
+    return fd;
+  }
+
+  void set(const std::string &key, std::string_view value, int64_t expiry) {
+    auto owned = std::make_shared<const std::string>(value);
+    index.insert_or_assign(key, Value{*owned, owned, expiry});
+  }
+
+  void load_snapshot(uint64_t gen) {
+    std::string path = snapshot_path(gen);
+    auto mapping = std::make_shared<Mapping>(path);
+    const char *p = mapping->data;
+    const char *end = p + mapping->size;
+    if (mapping->size < 24 || memcmp(p, SNAPSHOT_MAGIC, 8) != 0 ||
+        memcmp(end - 8, SNAPSHOT_END, 8) != 0) {
+      throw std::runtime_error(path + " is corrupt");
+    }
+    uint64_t count = read_raw<uint64_t>(p + 8);
+    p += 16;
+    end -= 8;
+    index.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+      if (static_cast<size_t>(end - p) < SNAPSHOT_HEADER) {
+        throw std::runtime_error(path + " is corrupt");
+      }
+      uint32_t key_size = read_raw<uint32_t>(p);
+      uint32_t value_size = read_raw<uint32_t>(p + 4);
+      int64_t expiry = read_raw<int64_t>(p + 8);
+      p += SNAPSHOT_HEADER;
+      if (static_cast<size_t>(end - p) < size_t(key_size) + value_size) {
+        throw std::runtime_error(path + " is corrupt");
+      }
+      index.insert_or_assign(
+          std::string(p, key_size),
+          Value{std::string_view(p + key_size, value_size), nullptr, expiry});
+      p += size_t(key_size) + value_size;
+    }
+    snapshot = std::move(mapping);
+  }
+
+  // Applies the log's records in order. A torn or corrupt tail, as a crash
+  // mid-append leaves, is cut off so later appends are not lost behind it.
+  void replay_log(uint64_t gen) {
+    std::string path = log_path(gen);
+    Mapping mapping(path);
+    const char *begin = mapping.data;
+    const char *p = begin;
+    const char *end = begin + mapping.size;
+    while (static_cast<size_t>(end - p) >= LOG_HEADER) {
+      uint32_t crc = read_raw<uint32_t>(p);
+      uint8_t op = p[4];
+      uint32_t key_size = read_raw<uint32_t>(p + 5);
+      uint32_t value_size = read_raw<uint32_t>(p + 9);
+      int64_t expiry = read_raw<int64_t>(p + 13);
+      size_t length = LOG_HEADER + size_t(key_size) + value_size;
+      if (static_cast<size_t>(end - p) < length ||
+          crc32(p + 4, length - 4) != crc || (op != PUT && op != DELETE)) {
+        break;
+      }
+      std::string key(p + LOG_HEADER, key_size);
+      if (op == PUT) {
+        set(key, std::string_view(p + LOG_HEADER + key_size, value_size),
+            expiry);
+      } else {
+        index.erase(key);
+      }
+      p += length;
+    }
+    if (p != end) {
+      std::cerr << "Local store: discarding " << (end - p)
+                << " unreadable bytes at the end of " << path << std::endl;
+      if (truncate(path.c_str(), p - begin) != 0) {
+        throw std::runtime_error("Cannot truncate " + path + ": " +
+                                 strerror(errno));
+      }
+    }
+  }
+
+  void remove_before(uint64_t gen) {
+    std::error_code error;
+    for (const auto &file : std::filesystem::directory_iterator(dir, error)) {
+      std::string name = file.path().filename().string();
+      uint64_t file_gen;
+      if ((parse_name(name, "snapshot-", ".dat", file_gen) ||
+           parse_name(name, "wal-", ".log", file_gen)) &&
+          file_gen < gen) {
+        std::filesystem::remove(file.path(), error);
+      }
+    }
+  }
+
+  void recover() {
+    std::filesystem::create_directories(dir);
+    std::vector<uint64_t> snapshots, logs;
+    for (const auto &file : std::filesystem::directory_iterator(dir)) {
+      std::string name = file.path().filename().string();
+      uint64_t gen;
+      if (parse_name(name, "snapshot-", ".dat", gen)) {
+        snapshots.push_back(gen);
+      } else if (parse_name(name, "wal-", ".log", gen)) {
+        logs.push_back(gen);
+      } else if (name.size() > 4 &&
+                 name.compare(name.size() - 4, 4, ".tmp") == 0) {
+        std::filesystem::remove(file.path()); // an interrupted snapshot
+      }
+    }
+    std::sort(snapshots.begin(), snapshots.end());
+    std::sort(logs.begin(), logs.end());
+
+    uint64_t base = snapshots.empty() ? 0 : snapshots.back();
+    if (base > 0) {
+      load_snapshot(base);
+    }
+    for (uint64_t gen : logs) {
+      if (gen >= base) {
+        replay_log(gen);
+      }
+    }
+    // Expiry is checked last, so an expired rewrite still hides an older
+    // value of the key.
+    int64_t now = now_millis();
+    for (auto it = index.begin(); it != index.end();) {
+      it = it->second.expiry <= now ? index.erase(it) : std::next(it);
+    }
+    remove_before(base);
+
+    generation = std::max<uint64_t>(
+        {1, base, logs.empty() ? uint64_t(0) : logs.back()});
+    log_fd = open_log(generation);
+    if (log_fd < 0) {
+      throw std::runtime_error("Cannot open the log");
+    }
+    struct stat st;
+    log_bytes = fstat(log_fd, &st) == 0 ? st.st_size : 0;
+  }
+
+  // Appends `record` to the log, with the lock held exclusively. A failed
+  // append is cut off again so the log stays readable past it.
+  bool append_log() {
+    if (!write_all(log_fd, record.data(), record.size())) {
+      std::cerr << "Local store write failed: " << strerror(errno)
+                << std::endl;
+      if (ftruncate(log_fd, log_bytes) != 0) {
+        std::cerr << "Local store cannot repair the log: " << strerror(errno)
+                  << std::endl;
+      }
+      return false;
+    }
+    log_bytes += record.size();
+    if (config.fsync == FsyncPolicy::ALWAYS) {
+      sync_file(log_fd);
+    } else {
+      unsynced = true;
+    }
+    return true;
+  }
+
+  // Writes the entries as a snapshot, recording where each value landed,
+  // or SKIPPED for entries that have expired.
+  bool write_snapshot(const std::string &path,
+                      const std::vector<std::pair<std::string, Value>> &entries,
+                      std::vector<size_t> &offsets) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      return false;
+    }
+    std::string buffer;
+    buffer.reserve(WRITE_BUFFER + 64 * 1024);
+    buffer.append(SNAPSHOT_MAGIC, 8);
+    append_raw<uint64_t>(buffer, 0); // count, filled in at the end
+    size_t flushed = 0;
+    uint64_t count = 0;
+    int64_t now = now_millis();
+    offsets.reserve(entries.size());
+    for (const auto &[key, value] : entries) {
+      if (value.expiry <= now) {
+        offsets.push_back(SKIPPED);
+        continue;
+      }
+      append_raw<uint32_t>(buffer, key.size());
+      append_raw<uint32_t>(buffer, value.data.size());
+      append_raw<int64_t>(buffer, value.expiry);
+      buffer += key;
+      offsets.push_back(flushed + buffer.size());
+      buffer += value.data;
+      count++;
+      if (buffer.size() >= WRITE_BUFFER) {
+        if (!write_all(fd, buffer.data(), buffer.size())) {
+          close(fd);
+          return false;
+        }
+        flushed += buffer.size();
+        buffer.clear();
+      }
+    }
+    buffer.append(SNAPSHOT_END, 8);
+    bool ok = write_all(fd, buffer.data(), buffer.size()) &&
+              pwrite(fd, &count, sizeof(count), 8) == sizeof(count);
+    if (ok) {
+      sync_file(fd);
+    }
+    close(fd);
+    return ok;
+  }
+
+  void sync_log() {
+    if (!unsynced.exchange(false)) {
+      return;
+    }
+    int fd;
+    {
+      std::shared_lock<std::shared_mutex> lock(mutex);
+      fd = dup(log_fd); // the log may be switched while syncing
+    }
+    if (fd >= 0) {
+      sync_file(fd);
+      close(fd);
+    }
+  }
+
+  bool should_compact() {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return log_bytes >= config.compact_bytes ||
+           (log_bytes > 0 && std::chrono::steady_clock::now() - last_snapshot >=
+                                 config.snapshot_interval);
+  }
+
+  void run_worker() {
+    std::unique_lock<std::mutex> lock(worker_mutex);
+    while (running) {
+      worker_cv.wait_for(lock, std::chrono::seconds(1),
+                         [this]() { return !running; });
+      if (!running) {
+        break;
+      }
+      lock.unlock();
+      if (config.fsync == FsyncPolicy::EVERYSEC) {
+        sync_log();
+      }
+      if (should_compact()) {
+        compact();
+      }
+      lock.lock();
+    }
+  }
+
+public:
+  // Recovers the directory's contents, or throws if it cannot be read.
+  explicit LocalStore(
+      const LocalStoreConfig &config = LocalStoreConfig::from_env())
+      : config(config), dir(config.dir) {
+    auto start = std::chrono::steady_clock::now();
+    try {
+      recover();
+    } catch (const std::exception &e) {
+      throw std::runtime_error("Local store recovery failed: " +
+                               std::string(e.what()));
+    }
+    last_snapshot = std::chrono::steady_clock::now();
+    std::cout << "Local store recovered " << index.size() << " entries from "
+              << dir.string() << " in "
+              << std::chrono::duration<double>(last_snapshot - start).count()
+              << "s" << std::endl;
+    worker = std::thread([this]() { run_worker(); });
+  }
+
+  ~LocalStore() {
+    {
+      std::lock_guard<std::mutex> lock(worker_mutex);
+      running = false;
+    }
+    worker_cv.notify_all();
+    worker.join();
+    if (config.fsync != FsyncPolicy::NEVER) {
+      sync_file(log_fd);
+    }
+    close(log_fd);
+  }
+
+  LocalStore(const LocalStore &) = delete;
+  LocalStore &operator=(const LocalStore &) = delete;
+
+  bool put(const std::string &key, const std::string &value,
+           const std::chrono::system_clock::time_point &expiry) override {
+    int64_t millis = to_millis(expiry);
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    record.clear();
+    append_record(record, PUT, key, value, millis);
+    if (!append_log()) {
+      return false;
+    }
+    set(key, value, millis);
+    return true;
+  }
+
+  // One append, and one sync under FsyncPolicy::ALWAYS, for the batch.
+  bool put_many(const std::vector<CacheRow> &rows) override {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    record.clear();
+    for (const auto &row : rows) {
+      append_record(record, row.deleted ? DELETE : PUT, row.key,
+                    row.deleted ? std::string_view() : row.value,
+                    to_millis(row.expiry));
+    }
+    if (!append_log()) {
+      return false;
+    }
+    for (const auto &row : rows) {
+      if (row.deleted) {
+        index.erase(row.key);
+      } else {
+        set(row.key, row.value, to_millis(row.expiry));
+      }
+    }
+    return true;
+  }
+
+  std::optional<std::string>
+  get(const std::string &key, std::chrono::seconds *remaining_ttl = nullptr,
+      bool * = nullptr) override {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = index.find(key);
+    int64_t now = now_millis();
+    if (it == index.end() || it->second.expiry <= now) {
+      return std::nullopt;
+    }
+    if (remaining_ttl) {
+      *remaining_ttl = std::chrono::seconds(
+          std::max<int64_t>(1, (it->second.expiry - now + 999) / 1000));
+    }
+    return std::string(it->second.data);
+  }
+
+  std::vector<CacheRow> get_many(const std::vector<std::string> &keys,
+                                 bool * = nullptr) override {
+    std::vector<CacheRow> rows;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    int64_t now = now_millis();
+    for (const auto &key : keys) {
+      auto it = index.find(key);
+      if (it != index.end() && it->second.expiry > now) {
+        rows.push_back({key, std::string(it->second.data),
+                        std::chrono::system_clock::time_point(
+                            std::chrono::milliseconds(it->second.expiry))});
+      }
+    }
+    return rows;
+  }
+
+  // Expired entries leave the files at the next compaction.
+  void cleanup_expired() override {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    int64_t now = now_millis();
+    for (auto it = index.begin(); it != index.end();) {
+      it = it->second.expiry <= now ? index.erase(it) : std::next(it);
+    }
+  }
+
+  // Starts the next generation and writes the index as of the switch to
+  // its snapshot, then deletes the files it supersedes. Writers wait only
+  // while the log is switched and while values are repointed into the new
+  // snapshot. On failure the previous files stay, and recovery still reads
+  // them along with the new log.
+  bool compact() {
+    std::lock_guard<std::mutex> serial(compact_mutex);
+    // Values point into `snapshot` or hold their string, so the copies stay
+    // valid unlocked until the new snapshot replaces it.
+    std::vector<std::pair<std::string, Value>> entries;
+    uint64_t next;
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex);
+      next = generation + 1;
+      int fd = open_log(next);
+      if (fd < 0) {
+        return false;
+      }
+      if (config.fsync != FsyncPolicy::NEVER) {
+        sync_file(log_fd);
+      }
+      close(log_fd);
+      log_fd = fd;
+      log_bytes = 0;
+      unsynced = false;
+      generation = next;
+      last_snapshot = std::chrono::steady_clock::now();
+      entries.reserve(index.size());
+      for (const auto &entry : index) {
+        entries.push_back(entry);
+      }
+    }
+
+    std::string path = snapshot_path(next);
+    std::vector<size_t> offsets;
+    std::shared_ptr<Mapping> mapping;
+    try {
+      if (!write_snapshot(path + ".tmp", entries, offsets) ||
+          rename((path + ".tmp").c_str(), path.c_str()) != 0) {
+        throw std::runtime_error(strerror(errno));
+      }
+      sync_dir();
+      mapping = std::make_shared<Mapping>(path);
+    } catch (const std::exception &e) {
+      std::cerr << "Local store snapshot failed: " << e.what() << std::endl;
+      unlink((path + ".tmp").c_str());
+      return false;
+    }
+
+    {
+      std::unique_lock<std::shared_mutex> lock(mutex);
+      for (size_t i = 0; i < entries.size(); i++) {
+        auto it = index.find(entries[i].first);
+        // Entries rewritten since the switch own their new value.
+        if (it == index.end() ||
+            it->second.data.data() != entries[i].second.data.data()) {
+          continue;
+        }
+        if (offsets[i] == SKIPPED) {
+          index.erase(it);
+          continue;
+        }
+        it->second.data = std::string_view(mapping->data + offsets[i],
+                                           it->second.data.size());
+        it->second.owned.reset();
+      }
+      snapshot = mapping;
+    }
+    remove_before(next);
+    return true;
+  }
+
+  size_t size() {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return index.size();
+  }
+
+  // Bytes in the current log, which the next compaction folds away.
+  size_t log_size() {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return log_bytes;
+  }
+};
+
+#endif
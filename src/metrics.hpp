@@ -1,75 +1,375 @@
 #ifndef METRICS_HPP
 #define METRICS_HPP
 
+#include "latency.hpp"
+#include "striped_counter.hpp"
 #include <prometheus/counter.h>
 #include <prometheus/exposer.h>
 #include <prometheus/gauge.h>
+#include <prometheus/histogram.h>
 #include <prometheus/registry.h>
+#include <string>
+#include <vector>
 
 class CacheMetrics {
+public:
+  // Storage calls timed by cache_db_query_duration_seconds.
+  enum class DbQuery { GET, GET_MANY, PUT, PUT_MANY };
+
 private:
   std::shared_ptr<prometheus::Registry> registry;
-  prometheus::Exposer exposer;
 
   // Families
-  prometheus::Family<prometheus::Counter> &cache_hits_family;
-  prometheus::Family<prometheus::Counter> &cache_misses_family;
-  prometheus::Family<prometheus::Counter> &evictions_family;
-  prometheus::Family<prometheus::Counter> &expired_items_family;
-  prometheus::Family<prometheus::Gauge> &cache_size_family;
-  prometheus::Family<prometheus::Gauge> &memory_usage_family;
+  prometheus::Family<prometheus::Gauge> &write_queue_depth_family;
+  prometheus::Family<prometheus::Counter> &write_coalesced_family;
+  prometheus::Family<prometheus::Counter> &write_rows_family;
+  prometheus::Family<prometheus::Counter> &write_failures_family;
+  prometheus::Family<prometheus::Counter> &write_dropped_family;
+  prometheus::Family<prometheus::Histogram> &write_flush_family;
+  prometheus::Family<prometheus::Histogram> &db_pool_wait_family;
+  prometheus::Family<prometheus::Counter> &db_broken_family;
+  prometheus::Family<prometheus::Counter> &import_rows_family;
+  prometheus::Family<prometheus::Counter> &import_bytes_family;
+  prometheus::Family<prometheus::Histogram> &import_batch_family;
+  prometheus::Family<prometheus::Gauge> &imports_active_family;
+  prometheus::Family<prometheus::Counter> &warmup_rows_family;
+  prometheus::Family<prometheus::Gauge> &warmup_active_family;
+  prometheus::Family<prometheus::Gauge> &warmup_duration_family;
 
   // Actual metrics
-  prometheus::Counter &cache_hits_counter;
-  prometheus::Counter &cache_misses_counter;
-  prometheus::Counter &evictions_counter;
-  prometheus::Counter &expired_items_counter;
-  prometheus::Gauge &cache_size_gauge;
-  prometheus::Gauge &memory_usage_gauge;
+  prometheus::Gauge &write_queue_depth_gauge;
+  prometheus::Counter &write_coalesced_counter;
+  prometheus::Counter &write_rows_counter;
+  prometheus::Counter &write_failures_counter;
+  prometheus::Counter &write_dropped_counter;
+  prometheus::Histogram &write_flush_histogram;
+  prometheus::Histogram &db_pool_wait_histogram;
+  prometheus::Counter &db_broken_counter;
+  prometheus::Counter &import_imported_counter;
+  prometheus::Counter &import_expired_counter;
+  prometheus::Counter &import_invalid_counter;
+  prometheus::Counter &import_bytes_counter;
+  prometheus::Histogram &import_batch_histogram;
+  prometheus::Gauge &imports_active_gauge;
+  prometheus::Counter &warmup_loaded_counter;
+  prometheus::Counter &warmup_skipped_counter;
+  prometheus::Gauge &warmup_active_gauge;
+  prometheus::Gauge &warmup_duration_gauge;
+
+  // Recorded on the hot paths, so kept off prometheus::Histogram.
+  std::shared_ptr<LatencyFamily> request_duration_family;
+  std::shared_ptr<LatencyFamily> db_query_family;
+  std::shared_ptr<LatencyFamily> lock_wait_family;
+  std::shared_ptr<LatencyFamily> lock_hold_family;
+  std::array<LatencyHistogram *, 4> db_query_histograms;
+
+  // Counted on every lookup, so striped and only summed at scrape time.
+  StripedCounter hit_count;
+  StripedCounter miss_count;
+  StripedCounter eviction_count;
+  StripedCounter expired_count;
+  StripedCounter read_coalesced_count;
+  StripedCounter db_lookups_avoided_count;
+  StripedCounter refresh_count;
+  StripedCounter stale_served_count;
+  // Families read from the cache's own state; see read_usage() and
+  // register_shards().
+  std::shared_ptr<ScrapedFamily> entries_family;
+  std::shared_ptr<ScrapedFamily> size_family;
+  std::shared_ptr<ScrapedFamily> memory_family;
+  std::shared_ptr<ScrapedFamily> shard_hits_family;
+  std::shared_ptr<ScrapedFamily> shard_misses_family;
+
+  // Declared last so it stops serving scrapes before anything it reads is
+  // destroyed.
+  prometheus::Exposer exposer;
+
+  std::shared_ptr<ScrapedFamily> scraped(const std::string &name,
+                                         const std::string &help,
+                                         prometheus::MetricType type) {
+    auto family = std::make_shared<ScrapedFamily>(name, help, type);
+    exposer.RegisterCollectable(family);
+    return family;
+  }
+
+  void scraped_counter(const std::string &name, const std::string &help,
+                       const StripedCounter &counter) {
+    scraped(name, help, prometheus::MetricType::Counter)->add({}, counter);
+  }
 
 public:
   CacheMetrics(const std::string &metrics_address = "0.0.0.0:9091")
       : registry(std::make_shared<prometheus::Registry>()),
-        exposer(metrics_address),
-        cache_hits_family(prometheus::BuildCounter()
-                              .Name("cache_hits_total")
-                              .Help("Total number of cache hits")
+        write_queue_depth_family(
+            prometheus::BuildGauge()
+                .Name("cache_write_queue_depth")
+                .Help("Distinct keys waiting to be written to the database")
+                .Register(*registry)),
+        write_coalesced_family(
+            prometheus::BuildCounter()
+                .Name("cache_write_coalesced_total")
+                .Help("Writes replaced by a newer write to the same key "
+                      "before being flushed")
+                .Register(*registry)),
+        write_rows_family(prometheus::BuildCounter()
+                              .Name("cache_write_rows_total")
+                              .Help("Rows written to the database")
                               .Register(*registry)),
-        cache_misses_family(prometheus::BuildCounter()
-                                .Name("cache_misses_total")
-                                .Help("Total number of cache misses")
-                                .Register(*registry)),
-        evictions_family(prometheus::BuildCounter()
-                             .Name("cache_evictions_total")
-                             .Help("Total number of cache evictions")
+        write_failures_family(prometheus::BuildCounter()
+                                  .Name("cache_write_flush_failures_total")
+                                  .Help("Database write batches that failed")
+                                  .Register(*registry)),
+        write_dropped_family(
+            prometheus::BuildCounter()
+                .Name("cache_write_dropped_total")
+                .Help("Writes never persisted because the write queue was "
+                      "full while the database was unavailable")
+                .Register(*registry)),
+        write_flush_family(prometheus::BuildHistogram()
+                               .Name("cache_write_flush_duration_seconds")
+                               .Help("Time to write one batch to the database")
+                               .Register(*registry)),
+        db_pool_wait_family(
+            prometheus::BuildHistogram()
+                .Name("cache_db_pool_wait_seconds")
+                .Help("Time spent waiting for a pooled database connection")
+                .Register(*registry)),
+        db_broken_family(prometheus::BuildCounter()
+                             .Name("cache_db_broken_connections_total")
+                             .Help("Pooled database connections dropped "
+                                   "after failing")
                              .Register(*registry)),
-        expired_items_family(prometheus::BuildCounter()
-                                 .Name("cache_expired_total")
-                                 .Help("Total number of expired items")
-                                 .Register(*registry)),
-        cache_size_family(prometheus::BuildGauge()
-                              .Name("cache_size_bytes")
-                              .Help("Current size of cache in bytes")
-                              .Register(*registry)),
-        memory_usage_family(prometheus::BuildGauge()
-                                .Name("cache_memory_usage_bytes")
-                                .Help("Current memory usage in bytes")
+        import_rows_family(
+            prometheus::BuildCounter()
+                .Name("cache_import_rows_total")
+                .Help("Rows read by POST /api/import, by outcome")
+                .Register(*registry)),
+        import_bytes_family(prometheus::BuildCounter()
+                                .Name("cache_import_bytes_total")
+                                .Help("Request body bytes imported")
                                 .Register(*registry)),
-        cache_hits_counter(cache_hits_family.Add({})),
-        cache_misses_counter(cache_misses_family.Add({})),
-        evictions_counter(evictions_family.Add({})),
-        expired_items_counter(expired_items_family.Add({})),
-        cache_size_gauge(cache_size_family.Add({})),
-        memory_usage_gauge(memory_usage_family.Add({})) {
+        import_batch_family(
+            prometheus::BuildHistogram()
+                .Name("cache_import_batch_duration_seconds")
+                .Help("Time to COPY and merge one import batch")
+                .Register(*registry)),
+        imports_active_family(prometheus::BuildGauge()
+                                  .Name("cache_imports_active")
+                                  .Help("Imports in progress")
+                                  .Register(*registry)),
+        warmup_rows_family(
+            prometheus::BuildCounter()
+                .Name("cache_warmup_rows_total")
+                .Help("Rows read by the boot warm-up, by outcome")
+                .Register(*registry)),
+        warmup_active_family(prometheus::BuildGauge()
+                                 .Name("cache_warmup_active")
+                                 .Help("1 while the boot warm-up is running")
+                                 .Register(*registry)),
+        warmup_duration_family(
+            prometheus::BuildGauge()
+                .Name("cache_warmup_duration_seconds")
+                .Help("How long the last boot warm-up took")
+                .Register(*registry)),
+        write_queue_depth_gauge(write_queue_depth_family.Add({})),
+        write_coalesced_counter(write_coalesced_family.Add({})),
+        write_rows_counter(write_rows_family.Add({})),
+        write_failures_counter(write_failures_family.Add({})),
+        write_dropped_counter(write_dropped_family.Add({})),
+        write_flush_histogram(write_flush_family.Add(
+            {}, prometheus::Histogram::BucketBoundaries{
+                    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+                    0.25, 0.5, 1.0})),
+        db_pool_wait_histogram(db_pool_wait_family.Add(
+            {}, prometheus::Histogram::BucketBoundaries{
+                    0.00001, 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1,
+                    0.5, 1.0, 5.0})),
+        db_broken_counter(db_broken_family.Add({})),
+        import_imported_counter(
+            import_rows_family.Add({{"outcome", "imported"}})),
+        import_expired_counter(import_rows_family.Add({{"outcome", "expired"}})),
+        import_invalid_counter(import_rows_family.Add({{"outcome", "invalid"}})),
+        import_bytes_counter(import_bytes_family.Add({})),
+        import_batch_histogram(import_batch_family.Add(
+            {}, prometheus::Histogram::BucketBoundaries{
+                    0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0,
+                    10.0})),
+        imports_active_gauge(imports_active_family.Add({})),
+        warmup_loaded_counter(warmup_rows_family.Add({{"outcome", "loaded"}})),
+        warmup_skipped_counter(
+            warmup_rows_family.Add({{"outcome", "skipped"}})),
+        warmup_active_gauge(warmup_active_family.Add({})),
+        warmup_duration_gauge(warmup_duration_family.Add({})),
+        request_duration_family(std::make_shared<LatencyFamily>(
+            "cache_http_request_duration_seconds",
+            "Time from reading an HTTP request to queueing its response, "
+            "by route and status",
+            std::vector<double>{0.00005, 0.0001, 0.00025, 0.0005, 0.001,
+                                0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25,
+                                0.5, 1.0, 2.5})),
+        db_query_family(std::make_shared<LatencyFamily>(
+            "cache_db_query_duration_seconds",
+            "Time the cache spent in storage reads and writes, by operation",
+            std::vector<double>{0.0001, 0.00025, 0.0005, 0.001, 0.0025,
+                                0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                                1.0, 2.5, 5.0})),
+        lock_wait_family(std::make_shared<LatencyFamily>(
+            "cache_lock_wait_seconds",
+            "Time spent waiting to acquire a cache shard lock",
+            std::vector<double>{0.0000001, 0.00000025, 0.0000005, 0.000001,
+                                0.0000025, 0.000005, 0.00001, 0.000025,
+                                0.00005, 0.0001, 0.00025, 0.0005, 0.001,
+                                0.005, 0.01})),
+        lock_hold_family(std::make_shared<LatencyFamily>(
+            "cache_lock_hold_seconds",
+            "Time a cache shard lock was held, sampled on one acquisition "
+            "in 16",
+            std::vector<double>{0.0000001, 0.00000025, 0.0000005, 0.000001,
+                                0.0000025, 0.000005, 0.00001, 0.000025,
+                                0.00005, 0.0001, 0.00025, 0.0005, 0.001,
+                                0.005, 0.01})),
+        db_query_histograms{&db_query_family->add({{"op", "get"}}),
+                            &db_query_family->add({{"op", "get_many"}}),
+                            &db_query_family->add({{"op", "put"}}),
+                            &db_query_family->add({{"op", "put_many"}})},
+        exposer(metrics_address) {
     exposer.RegisterCollectable(registry);
+    exposer.RegisterCollectable(request_duration_family);
+    exposer.RegisterCollectable(db_query_family);
+    exposer.RegisterCollectable(lock_wait_family);
+    exposer.RegisterCollectable(lock_hold_family);
+
+    scraped_counter("cache_hits_total", "Total number of cache hits",
+                    hit_count);
+    scraped_counter("cache_misses_total", "Total number of cache misses",
+                    miss_count);
+    scraped_counter("cache_evictions_total", "Total number of cache evictions",
+                    eviction_count);
+    scraped_counter("cache_expired_total", "Total number of expired items",
+                    expired_count);
+    scraped_counter("cache_read_coalesced_total",
+                    "Cache misses that waited on another request's "
+                    "database load of the same key",
+                    read_coalesced_count);
+    scraped_counter("cache_db_lookups_avoided_total",
+                    "Cache misses answered from the negative cache "
+                    "without querying the database",
+                    db_lookups_avoided_count);
+    scraped_counter("cache_refreshes_total",
+                    "Entries reloaded from the database in the background "
+                    "because they were read close to or past their expiry",
+                    refresh_count);
+    scraped_counter("cache_stale_served_total",
+                    "Expired entries served, marked stale, while they were "
+                    "reloaded",
+                    stale_served_count);
+    entries_family = scraped("cache_entries",
+                             "Number of entries held in memory",
+                             prometheus::MetricType::Gauge);
+    size_family = scraped("cache_size_bytes",
+                          "Key and value bytes held in memory",
+                          prometheus::MetricType::Gauge);
+    memory_family = scraped("cache_memory_usage_bytes",
+                            "Bytes charged for cached entries, including "
+                            "per-entry overhead",
+                            prometheus::MetricType::Gauge);
+    shard_hits_family = scraped("cache_shard_hits_total",
+                                "In-memory cache hits per shard",
+                                prometheus::MetricType::Counter);
+    shard_misses_family = scraped("cache_shard_misses_total",
+                                  "In-memory cache misses per shard",
+                                  prometheus::MetricType::Counter);
+  }
+
+  void record_hit() { hit_count.increment(); }
+  void record_miss(size_t count = 1) { miss_count.increment(count); }
+  void record_eviction() { eviction_count.increment(); }
+  void record_expired(size_t count = 1) { expired_count.increment(count); }
+
+  // Sets where the memory gauges are read from at scrape time: entries
+  // held, their key and value bytes, and the bytes charged for them. Call
+  // once; the readers must stay valid while these metrics exist.
+  void read_usage(ScrapedFamily::Reader entries, ScrapedFamily::Reader size,
+                  ScrapedFamily::Reader memory) {
+    entries_family->add({}, std::move(entries));
+    size_family->add({}, std::move(size));
+    memory_family->add({}, std::move(memory));
+  }
+
+  void update_write_queue_depth(double depth) {
+    write_queue_depth_gauge.Set(depth);
+  }
+  void record_write_coalesced() { write_coalesced_counter.Increment(); }
+  void record_read_coalesced() { read_coalesced_count.increment(); }
+  void record_db_lookup_avoided(size_t count = 1) {
+    db_lookups_avoided_count.increment(count);
+  }
+  void record_refresh() { refresh_count.increment(); }
+  void record_stale_served() { stale_served_count.increment(); }
+  void record_write_dropped(size_t rows = 1) {
+    write_dropped_counter.Increment(rows);
+  }
+  void observe_write_flush(double seconds, size_t rows, bool ok) {
+    write_flush_histogram.Observe(seconds);
+    if (ok) {
+      write_rows_counter.Increment(rows);
+    } else {
+      write_failures_counter.Increment();
+    }
+  }
+
+  void observe_db_pool_wait(double seconds) {
+    db_pool_wait_histogram.Observe(seconds);
+  }
+  void record_db_broken_connection() { db_broken_counter.Increment(); }
+
+  void record_import_started() { imports_active_gauge.Increment(); }
+  void record_import_finished() { imports_active_gauge.Decrement(); }
+  void record_import_bytes(size_t bytes) { import_bytes_counter.Increment(bytes); }
+  void record_import_invalid() { import_invalid_counter.Increment(); }
+  void observe_import_batch(double seconds, size_t imported, size_t expired) {
+    import_batch_histogram.Observe(seconds);
+    import_imported_counter.Increment(imported);
+    import_expired_counter.Increment(expired);
+  }
+
+  void record_warmup_started() { warmup_active_gauge.Set(1); }
+  void observe_warmup_batch(size_t loaded, size_t skipped) {
+    warmup_loaded_counter.Increment(loaded);
+    warmup_skipped_counter.Increment(skipped);
   }
+  void record_warmup_finished(double seconds) {
+    warmup_active_gauge.Set(0);
+    warmup_duration_gauge.Set(seconds);
+  }
+
+  // Series are per route and status; callers keep the ones they use.
+  LatencyFamily &request_durations() { return *request_duration_family; }
 
-  void record_hit() { cache_hits_counter.Increment(); }
-  void record_miss() { cache_misses_counter.Increment(); }
-  void record_eviction() { evictions_counter.Increment(); }
-  void record_expired() { expired_items_counter.Increment(); }
-  void update_size(double size) { cache_size_gauge.Set(size); }
-  void update_memory(double memory) { memory_usage_gauge.Set(memory); }
+  void observe_db_query(DbQuery query,
+                        std::chrono::steady_clock::duration elapsed) {
+    db_query_histograms[static_cast<size_t>(query)]->observe(elapsed);
+  }
+
+  LatencyHistogram &lock_wait_histogram() { return lock_wait_family->add({}); }
+  LatencyHistogram &lock_hold_histogram() { return lock_hold_family->add({}); }
+
+  // Exposes per-shard hit and miss counts, which the shards keep
+  // themselves under their locks. Call once; the readers must stay valid
+  // while these metrics exist.
+  void register_shards(size_t count,
+                       std::function<uint64_t(size_t)> shard_hits,
+                       std::function<uint64_t(size_t)> shard_misses) {
+    for (size_t i = 0; i < count; i++) {
+      prometheus::Labels labels = {{"shard", std::to_string(i)}};
+      shard_hits_family->add(labels, [shard_hits, i]() {
+        return static_cast<double>(shard_hits(i));
+      });
+      shard_misses_family->add(labels, [shard_misses, i]() {
+        return static_cast<double>(shard_misses(i));
+      });
+    }
+  }
 };
 
 #endif
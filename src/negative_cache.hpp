@@ -0,0 +1,101 @@
+#ifndef NEGATIVE_CACHE_HPP
+#define NEGATIVE_CACHE_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
+
+struct NegativeCacheConfig {
+  // Absent keys remembered across all shards; 0 disables negative caching.
+  size_t max_entries = 10000;
+  // How long a miss is trusted. Another server may write the key to the
+  // database meanwhile, so keep this short.
+  std::chrono::milliseconds ttl = std::chrono::milliseconds(5000);
+
+  static NegativeCacheConfig from_env() {
+    NegativeCacheConfig config;
+    if (const char *max = std::getenv("CACHE_NEGATIVE_MAX")) {
+      config.max_entries = std::max(0L, std::strtol(max, nullptr, 10));
+    }
+    if (const char *ttl = std::getenv("CACHE_NEGATIVE_TTL_MS")) {
+      config.ttl = std::chrono::milliseconds(
+          std::max(0L, std::strtol(ttl, nullptr, 10)));
+    }
+    return config;
+  }
+};
+
+// Keys recently found missing from the database, so repeated lookups can be
+// answered "absent" without a query. Holds at most `capacity` keys, oldest
+// out first, and each for `ttl` at most. Not thread-safe.
+template <typename K, typename Hash = std::hash<K>> class NegativeCache {
+private:
+  struct Entry {
+    std::chrono::steady_clock::time_point expiry;
+    typename std::list<const K *>::iterator order;
+  };
+
+  std::unordered_map<K, Entry, Hash> entries;
+  std::list<const K *> order; // oldest first
+  size_t capacity;
+  std::chrono::milliseconds ttl;
+
+  void erase(typename std::unordered_map<K, Entry, Hash>::iterator it) {
+    order.erase(it->second.order);
+    entries.erase(it);
+  }
+
+public:
+  NegativeCache(size_t capacity, std::chrono::milliseconds ttl)
+      : capacity(capacity), ttl(ttl) {}
+
+  bool contains(const K &key, std::chrono::steady_clock::time_point now) {
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+      return false;
+    }
+    if (now >= it->second.expiry) {
+      erase(it);
+      return false;
+    }
+    return true;
+  }
+
+  void insert(const K &key, std::chrono::steady_clock::time_point now) {
+    if (capacity == 0 || ttl.count() == 0) {
+      return;
+    }
+    auto [it, inserted] = entries.try_emplace(key);
+    it->second.expiry = now + ttl;
+    if (!inserted) {
+      order.splice(order.end(), order, it->second.order);
+      return;
+    }
+    it->second.order = order.insert(order.end(), &it->first);
+    if (entries.size() > capacity) {
+      erase(entries.find(*order.front()));
+    }
+  }
+
+  // Called when the key is written, so it is no longer absent.
+  void erase(const K &key) {
+    if (entries.empty()) {
+      return;
+    }
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+      erase(it);
+    }
+  }
+
+  size_t size() const { return entries.size(); }
+
+  void clear() {
+    entries.clear();
+    order.clear();
+  }
+};
+
+#endif
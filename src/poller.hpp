@@ -0,0 +1,134 @@
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+// Edge-triggered readiness notification: epoll on Linux, kqueue elsewhere.
+// Descriptors are registered once for both directions, so callers must drain
+// reads and writes until EAGAIN after every notification.
+class Poller {
+public:
+  enum Event : uint32_t { READABLE = 1, WRITABLE = 2, HANGUP = 4 };
+
+  struct Ready {
+    int fd;
+    uint32_t events;
+  };
+
+private:
+  int poll_fd;
+#ifdef __linux__
+  std::vector<epoll_event> events;
+#else
+  std::vector<struct kevent> events;
+#endif
+
+public:
+  explicit Poller(size_t max_events = 256) : events(max_events) {
+#ifdef __linux__
+    poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    poll_fd = kqueue();
+#endif
+    if (poll_fd < 0) {
+      throw std::runtime_error("Poller creation failed: " +
+                               std::string(strerror(errno)));
+    }
+  }
+
+  ~Poller() { close(poll_fd); }
+
+  Poller(const Poller &) = delete;
+  Poller &operator=(const Poller &) = delete;
+
+  bool add(int fd) {
+#ifdef __linux__
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    return epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+    struct kevent changes[2];
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    return kevent(poll_fd, changes, 2, nullptr, 0, nullptr) == 0;
+#endif
+  }
+
+  // Closing a descriptor also drops its registration; this is only needed
+  // when a descriptor stays open after it leaves the poller.
+  void remove(int fd) {
+#ifdef __linux__
+    epoll_ctl(poll_fd, EPOLL_CTL_DEL, fd, nullptr);
+#else
+    struct kevent changes[2];
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+    kevent(poll_fd, changes, 2, nullptr, 0, nullptr);
+#endif
+  }
+
+  // Returns the number of ready descriptors written to `ready`, or -1 on a
+  // non-EINTR failure.
+  int wait(std::vector<Ready> &ready, int timeout_ms) {
+    ready.clear();
+#ifdef __linux__
+    int n = epoll_wait(poll_fd, events.data(), static_cast<int>(events.size()),
+                       timeout_ms);
+    if (n < 0) {
+      return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < n; i++) {
+      uint32_t flags = 0;
+      if (events[i].events & EPOLLIN)
+        flags |= READABLE;
+      if (events[i].events & EPOLLOUT)
+        flags |= WRITABLE;
+      if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        flags |= HANGUP;
+      ready.push_back({events[i].data.fd, flags});
+    }
+#else
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    int n = kevent(poll_fd, nullptr, 0, events.data(),
+                   static_cast<int>(events.size()), &ts);
+    if (n < 0) {
+      return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < n; i++) {
+      uint32_t flags = 0;
+      if (events[i].filter == EVFILT_READ)
+        flags |= READABLE;
+      if (events[i].filter == EVFILT_WRITE)
+        flags |= WRITABLE;
+      if (events[i].flags & (EV_EOF | EV_ERROR))
+        flags |= HANGUP;
+      ready.push_back({static_cast<int>(events[i].ident), flags});
+    }
+#endif
+    return static_cast<int>(ready.size());
+  }
+
+  static bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+  }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef REAPER_HPP
+#define REAPER_HPP
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Destroys objects whose destructors may block, such as a stream joining
+// its worker thread, on a thread of its own, so the event loop that drops
+// one never waits for it. Whatever is still queued is destroyed before the
+// reaper itself is.
+class Reaper {
+private:
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::vector<std::shared_ptr<void>> doomed;
+  bool running = true;
+  std::thread thread;
+
+  void run() {
+    std::vector<std::shared_ptr<void>> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running || !doomed.empty()) {
+      work_ready.wait(lock, [this]() { return !running || !doomed.empty(); });
+      batch.swap(doomed);
+      lock.unlock();
+      batch.clear();
+      lock.lock();
+    }
+  }
+
+public:
+  Reaper() : thread([this]() { run(); }) {}
+
+  ~Reaper() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    work_ready.notify_one();
+    thread.join();
+  }
+
+  Reaper(const Reaper &) = delete;
+  Reaper &operator=(const Reaper &) = delete;
+
+  template <typename T> void retire(std::unique_ptr<T> object) {
+    if (!object) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      doomed.emplace_back(std::move(object));
+    }
+    work_ready.notify_one();
+  }
+};
+
+#endif
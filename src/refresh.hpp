@@ -0,0 +1,111 @@
+#ifndef REFRESH_HPP
+#define REFRESH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct RefreshConfig {
+  // Fraction of an entry's TTL, at its end, within which a read reloads it
+  // from the database in the background; 0 disables refresh-ahead.
+  double ahead = 0;
+  // How long past its expiry an entry may still be served, marked stale,
+  // while it is reloaded; 0 never serves expired entries.
+  std::chrono::seconds stale{0};
+  size_t workers = 2;
+  // Reloads waiting for a worker; further ones are dropped, and their
+  // entries simply expire.
+  size_t max_pending = 10000;
+
+  bool enabled() const { return ahead > 0 || stale.count() > 0; }
+
+  static RefreshConfig from_env() {
+    RefreshConfig config;
+    if (const char *ahead = std::getenv("CACHE_REFRESH_AHEAD")) {
+      config.ahead = std::clamp(std::atof(ahead), 0.0, 1.0);
+    }
+    if (const char *stale = std::getenv("CACHE_SERVE_STALE_SECS")) {
+      config.stale =
+          std::chrono::seconds(std::max(0L, std::strtol(stale, nullptr, 10)));
+    }
+    if (const char *workers = std::getenv("CACHE_REFRESH_WORKERS")) {
+      config.workers = std::max(1L, std::strtol(workers, nullptr, 10));
+    }
+    if (const char *max = std::getenv("CACHE_REFRESH_QUEUE_MAX")) {
+      config.max_pending = std::max(1L, std::strtol(max, nullptr, 10));
+    }
+    return config;
+  }
+};
+
+// Runs `reload` for submitted keys on a few background threads, so reads
+// that find an entry about to expire never wait on the database. Keys
+// still queued when it is destroyed are dropped.
+template <typename K> class RefreshQueue {
+public:
+  using Reload = std::function<void(const K &)>;
+
+private:
+  Reload reload;
+  size_t max_pending;
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::deque<K> pending;
+  bool running = true;
+  std::vector<std::thread> workers;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      work_ready.wait(lock, [this]() { return !pending.empty() || !running; });
+      if (!running) {
+        return;
+      }
+      K key = std::move(pending.front());
+      pending.pop_front();
+      lock.unlock();
+      reload(key);
+      lock.lock();
+    }
+  }
+
+public:
+  RefreshQueue(const RefreshConfig &config, Reload reload)
+      : reload(std::move(reload)), max_pending(config.max_pending) {
+    for (size_t i = 0; i < config.workers; i++) {
+      workers.emplace_back([this]() { run(); });
+    }
+  }
+
+  ~RefreshQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    work_ready.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  // Queues a reload of `key`; false if the queue is full.
+  bool submit(const K &key) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (pending.size() >= max_pending) {
+        return false;
+      }
+      pending.push_back(key);
+    }
+    work_ready.notify_one();
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef RESP_HPP
+#define RESP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// A parsed command: the command name followed by its arguments. Every view
+// points into the connection buffer and stays valid until that buffer is
+// modified.
+struct RespCommand {
+  std::vector<std::string_view> args;
+
+  // True if `arg` is the upper-case `name`, ignoring ASCII case as Redis
+  // does for command names and options.
+  static bool matches(std::string_view arg, std::string_view name) {
+    if (arg.size() != name.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < name.size(); i++) {
+      char c = arg[i];
+      if (c >= 'a' && c <= 'z')
+        c -= 'a' - 'A';
+      if (c != name[i])
+        return false;
+    }
+    return true;
+  }
+
+  bool is(std::string_view name) const {
+    return !args.empty() && matches(args[0], name);
+  }
+};
+
+// Incremental parser for Redis (RESP2) client commands: arrays of bulk
+// strings, plus space-separated inline commands as typed into telnet.
+// parse() is called with the unconsumed front of the connection buffer each
+// time more bytes arrive and resumes after the last complete argument.
+// Positions are kept as offsets, so the buffer may move between calls.
+class RespParser {
+public:
+  enum class Status { INCOMPLETE, COMPLETE, ERROR };
+
+private:
+  static const size_t MAX_LINE_BYTES = 64 * 1024;
+
+  size_t max_command_bytes; // whole command, headers included
+  size_t max_args;
+
+  size_t pos = 0;      // first byte not yet parsed
+  long expected = -1;  // arguments announced by the array header
+  size_t needed = 0;   // bytes the pending bulk string ends at
+  size_t consumed_bytes = 0;
+  std::vector<std::pair<size_t, size_t>> spans; // offset, length per arg
+  const char *error = nullptr;
+
+  Status fail(const char *message) {
+    error = message;
+    return Status::ERROR;
+  }
+
+  // Reads "<prefix><integer>\r\n" at pos. Returns INCOMPLETE without
+  // moving if the line has not fully arrived.
+  Status read_length(const char *data, size_t size, char prefix, long &out) {
+    const char *begin = data + pos;
+    const char *end =
+        static_cast<const char *>(memchr(begin, '\n', size - pos));
+    if (!end) {
+      return size - pos > 32 ? fail("Protocol error: invalid length")
+                             : Status::INCOMPLETE;
+    }
+    if (*begin != prefix || end - begin < 3 || end[-1] != '\r') {
+      return fail(prefix == '$' ? "Protocol error: expected '$'"
+                                : "Protocol error: invalid multibulk length");
+    }
+    long value = 0;
+    for (const char *p = begin + 1; p < end - 1; p++) {
+      if (*p < '0' || *p > '9' || value > (1L << 40)) {
+        return fail(prefix == '$' ? "Protocol error: invalid bulk length"
+                                  : "Protocol error: invalid multibulk length");
+      }
+      value = value * 10 + (*p - '0');
+    }
+    out = value;
+    pos = end - data + 1;
+    return Status::COMPLETE;
+  }
+
+  Status parse_inline(const char *data, size_t size) {
+    const char *end = static_cast<const char *>(memchr(data, '\n', size));
+    if (!end) {
+      return size > MAX_LINE_BYTES ? fail("Protocol error: too big inline "
+                                          "request")
+                                   : Status::INCOMPLETE;
+    }
+    size_t line_end = end - data;
+    size_t length = line_end > 0 && data[line_end - 1] == '\r' ? line_end - 1
+                                                               : line_end;
+    size_t i = 0;
+    while (i < length) {
+      while (i < length && data[i] == ' ')
+        i++;
+      size_t start = i;
+      while (i < length && data[i] != ' ')
+        i++;
+      if (i > start) {
+        if (spans.size() == max_args) {
+          return fail("Protocol error: too many arguments");
+        }
+        spans.emplace_back(start, i - start);
+      }
+    }
+    consumed_bytes = line_end + 1;
+    return Status::COMPLETE;
+  }
+
+public:
+  // A command larger than `max_command_bytes` in all fails as soon as a
+  // header announces it, so its bytes are never buffered.
+  explicit RespParser(size_t max_command_bytes = 4 * 1024 * 1024,
+                      size_t max_args = 64 * 1024)
+      : max_command_bytes(max_command_bytes), max_args(max_args) {}
+
+  // Parses the command at the front of `data`. Returns INCOMPLETE until the
+  // whole command has arrived; after COMPLETE, consumed() bytes belong to
+  // it and reset() must be called before parsing the next one. An empty
+  // inline line completes with no arguments and should be skipped.
+  Status parse(const char *data, size_t size, RespCommand &command) {
+    if (error) {
+      return Status::ERROR;
+    }
+    if (size == 0) {
+      return Status::INCOMPLETE;
+    }
+
+    if (expected < 0) {
+      if (data[0] != '*') {
+        Status status = parse_inline(data, size);
+        if (status != Status::COMPLETE) {
+          return status;
+        }
+        command.args.clear();
+        for (const auto &span : spans) {
+          command.args.emplace_back(data + span.first, span.second);
+        }
+        return status;
+      }
+      Status status = read_length(data, size, '*', expected);
+      if (status != Status::COMPLETE) {
+        return status;
+      }
+      if (static_cast<size_t>(expected) > max_args) {
+        return fail("Protocol error: invalid multibulk length");
+      }
+      spans.reserve(std::min<size_t>(expected, 1024));
+    }
+
+    while (spans.size() < static_cast<size_t>(expected)) {
+      if (needed == 0) {
+        long length;
+        Status status = read_length(data, size, '$', length);
+        if (status != Status::COMPLETE) {
+          return status;
+        }
+        if (static_cast<size_t>(length) > max_command_bytes) {
+          return fail("Protocol error: invalid bulk length");
+        }
+        if (pos + length + 2 > max_command_bytes) {
+          return fail("Protocol error: command too large");
+        }
+        needed = pos + length + 2;
+      }
+      if (size < needed) {
+        return Status::INCOMPLETE;
+      }
+      if (data[needed - 2] != '\r' || data[needed - 1] != '\n') {
+        return fail("Protocol error: bulk string not terminated by CRLF");
+      }
+      spans.emplace_back(pos, needed - 2 - pos);
+      pos = needed;
+      needed = 0;
+    }
+
+    command.args.clear();
+    for (const auto &span : spans) {
+      command.args.emplace_back(data + span.first, span.second);
+    }
+    consumed_bytes = pos;
+    return Status::COMPLETE;
+  }
+
+  size_t consumed() const { return consumed_bytes; }
+
+  // Where the bulk string being received ends, so the caller can size its
+  // buffer up front; 0 when not inside one.
+  size_t bytes_needed() const { return needed; }
+
+  // Message for the "-ERR" reply to a malformed command.
+  const char *error_message() const { return error; }
+
+  void reset() {
+    pos = 0;
+    expected = -1;
+    needed = consumed_bytes = 0;
+    spans.clear();
+    error = nullptr;
+  }
+};
+
+// Appends RESP2 replies to a connection's output buffer.
+namespace resp {
+
+inline void simple(std::string &out, std::string_view text) {
+  out += '+';
+  out.append(text.data(), text.size());
+  out += "\r\n";
+}
+
+inline void error(std::string &out, std::string_view message) {
+  out += "-ERR ";
+  out.append(message.data(), message.size());
+  out += "\r\n";
+}
+
+inline void integer(std::string &out, int64_t value) {
+  out += ':';
+  out += std::to_string(value);
+  out += "\r\n";
+}
+
+inline void bulk(std::string &out, std::string_view value) {
+  out += '$';
+  out += std::to_string(value.size());
+  out += "\r\n";
+  out.append(value.data(), value.size());
+  out += "\r\n";
+}
+
+inline void null(std::string &out) { out += "$-1\r\n"; }
+
+inline void array(std::string &out, size_t count) {
+  out += '*';
+  out += std::to_string(count);
+  out += "\r\n";
+}
+
+} // namespace resp
+
+#endif
@@ -1,207 +1,979 @@
 #include "server.hpp"
 
-std::string HttpServer::handle_request(const std::string &request) {
-  if (request.find("GET /api/export") != std::string::npos) {
-    return export_cache_data();
-  } else if (request.find("POST /api/cached") != std::string::npos) {
-    size_t body_start = request.find("\r\n\r\n") + 4;
-    if (body_start != std::string::npos) {
-      try {
-        json request_body = json::parse(request.substr(body_start));
-        std::string key = request_body["key"].get<std::string>();
-        std::string value = request_body["value"].get<std::string>();
-        int ttl = request_body.value("ttl", 300);
-        cache.put(key, value, std::chrono::seconds(ttl));
-        json response = {{"message", "Entry cached successfully"},
-                         {"key", key},
-                         {"ttl", ttl},
-                         {"status", "success"}};
-        return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" +
-               response.dump();
-      } catch (const json::parse_error &e) {
-        json error = {{"error", "Invalid JSON"}, {"status", "error"}};
-        return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-               "application/json\r\n\r\n" +
-               error.dump();
-      }
-    }
-  }
-
-  else if (request.find("GET /api/cached/") != std::string::npos) {
-    size_t start_pos = request.find("/api/cached/") + 12;
-    size_t end_pos = request.find(" HTTP/");
-
-    if (start_pos == std::string::npos || end_pos == std::string::npos ||
-        start_pos >= end_pos) {
+HttpResponse HttpServer::handle_request(const HttpRequest &request) {
+  const std::string_view method = request.method;
+  const std::string_view path = request.path;
+  const bool is_get = method == "GET" || method == "HEAD";
+
+  if (method == "POST" && path == "/api/cached") {
+    try {
+      json request_body = json::parse(request.body.begin(), request.body.end());
+      std::string key = request_body["key"].get<std::string>();
+      std::string value = request_body["value"].get<std::string>();
+      int ttl = request_body.value("ttl", 300);
+      if (!cache.put(key, value, std::chrono::seconds(ttl))) {
+        json error = {{"error", "Failed to persist entry"},
+                      {"status", "error"}};
+        return HttpResponse(500, error.dump());
+      }
+      json response = {{"message", "Entry cached successfully"},
+                       {"key", key},
+                       {"ttl", ttl},
+                       {"status", "success"}};
+      return HttpResponse(200, response.dump());
+    } catch (const json::parse_error &e) {
+      json error = {{"error", "Invalid JSON"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
+    } catch (const json::exception &e) {
       json error = {{"error", "Invalid request"}, {"status", "error"}};
-      return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-             "application/json\r\n\r\n" +
-             error.dump();
+      return HttpResponse(400, error.dump());
     }
+  }
 
-    std::string key = request.substr(start_pos, end_pos - start_pos);
-    std::string value;
+  else if (method == "POST" && path == "/api/cached/batch") {
+    try {
+      json request_body = json::parse(request.body.begin(), request.body.end());
+      std::vector<LRUCache<std::string, std::string>::Entry> entries;
+      for (const auto &item : request_body.at("entries")) {
+        entries.push_back({item.at("key").get<std::string>(),
+                           item.at("value").get<std::string>(),
+                           std::chrono::seconds(item.value("ttl", 300))});
+      }
+      if (!cache.put_many(entries)) {
+        json error = {{"error", "Failed to persist entries"},
+                      {"status", "error"}};
+        return HttpResponse(500, error.dump());
+      }
+      json response = {{"message", "Entries cached successfully"},
+                       {"count", entries.size()},
+                       {"status", "success"}};
+      return HttpResponse(200, response.dump());
+    } catch (const json::parse_error &e) {
+      json error = {{"error", "Invalid JSON"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
+    } catch (const json::exception &e) {
+      json error = {{"error", "Invalid request"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
+    }
+  }
 
-    if (cache.get(key, value)) {
+  else if (method == "POST" && path == "/api/cached/batch/get") {
+    try {
+      json request_body = json::parse(request.body.begin(), request.body.end());
+      auto keys = request_body.at("keys").get<std::vector<std::string>>();
+      auto values = cache.get_many(keys);
+
+      json found = json::object();
+      json missing = json::array();
+      for (size_t i = 0; i < keys.size(); i++) {
+        if (values[i]) {
+          found[keys[i]] = *values[i];
+        } else {
+          missing.push_back(keys[i]);
+        }
+      }
+      json response = {
+          {"entries", found}, {"missing", missing}, {"status", "success"}};
+      return HttpResponse(200, response.dump());
+    } catch (const json::parse_error &e) {
+      json error = {{"error", "Invalid JSON"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
+    } catch (const json::exception &e) {
+      json error = {{"error", "Invalid request"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
+    }
+  }
+
+  else if (is_get && path.substr(0, 12) == "/api/cached/") {
+    std::string key(path.substr(12));
+    if (key.empty()) {
+      json error = {{"error", "Invalid request"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
+    }
+
+    std::string value;
+    bool stale;
+    if (cache.get(key, value, &stale)) {
       json response = {{"key", key}, {"value", value}, {"status", "success"}};
-      return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" +
-             response.dump();
+      HttpResponse ok(200, response.dump());
+      if (stale) {
+        ok.extra_headers = STALE_HEADER;
+      }
+      return ok;
     } else {
       json error = {{"error", "Key not found"}, {"status", "error"}};
-      return "HTTP/1.1 404 Not Found\r\nContent-Type: "
-             "application/json\r\n\r\n" +
-             error.dump();
+      return HttpResponse(404, error.dump());
     }
   }
 
-  else if (request.find("POST /api/cache/clear") != std::string::npos) {
+  else if (method == "POST" && path == "/api/cache/clear") {
     cache.clear();
     json response = {{"message", "Cache cleared"}, {"status", "success"}};
-    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" +
-           response.dump();
+    return HttpResponse(200, response.dump());
   }
 
-  else if (request.find("GET /api/hello") != std::string::npos) {
+  else if (is_get && path == "/api/hello") {
     json response = {{"message", "Hello, World!"}, {"status", "success"}};
-    return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" +
-           response.dump();
+    return HttpResponse(200, response.dump());
   }
 
-  else if (request.find("POST /api/echo") != std::string::npos) {
-    size_t body_start = request.find("\r\n\r\n") + 4;
-    if (body_start != std::string::npos) {
-      try {
-        json request_body = json::parse(request.substr(body_start));
-        json response = {{"echo", request_body}, {"status", "success"}};
-        return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" +
-               response.dump();
-      } catch (const json::parse_error &e) {
-        json error = {{"error", "Invalid JSON"}, {"status", "error"}};
-        return "HTTP/1.1 400 Bad Request\r\nContent-Type: "
-               "application/json\r\n\r\n" +
-               error.dump();
-      }
+  else if (method == "POST" && path == "/api/echo") {
+    try {
+      json request_body = json::parse(request.body.begin(), request.body.end());
+      json response = {{"echo", request_body}, {"status", "success"}};
+      return HttpResponse(200, response.dump());
+    } catch (const json::parse_error &e) {
+      json error = {{"error", "Invalid JSON"}, {"status", "error"}};
+      return HttpResponse(400, error.dump());
     }
   }
 
   json error = {{"error", "Not Found"}, {"status", "error"}};
-  return "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\n\r\n" +
-         error.dump();
+  return HttpResponse(404, error.dump());
 }
 
-HttpServer::HttpServer(int port, std::atomic<bool> &stop)
-    : port(port), stop_signal(stop), cache(1024, std::chrono::seconds(300)) {};
+bool HttpServer::handle_fast(Connection &conn, bool keep_alive) {
+  const HttpRequest &request = conn.request;
+  const std::string_view method = request.method;
+  const std::string_view path = request.path;
+  json_fast::CacheEntryRequest &entry = conn.entry;
 
-void HttpServer::start() {
+  if (method == "POST" && path == "/api/cached") {
+    json_fast::Parser parser;
+    if (!parser.parse_entry(request.body, entry, conn.scratch)) {
+      return false;
+    }
+    if (!cache.put(entry.key, entry.value, std::chrono::seconds(entry.ttl))) {
+      HttpResponse::write_json(conn.out, 500,
+                               {{"error", "Failed to persist entry"},
+                                {"status", "error"}},
+                               keep_alive);
+      return true;
+    }
+    HttpResponse::write_json(conn.out, 200,
+                             {{"key", entry.key},
+                              {"message", "Entry cached successfully"},
+                              {"status", "success"},
+                              {"ttl", entry.ttl}},
+                             keep_alive);
+    return true;
+  }
+
+  bool is_get = method == "GET" || method == "HEAD";
+  if (!is_get || path.size() <= 12 || path.substr(0, 12) != "/api/cached/") {
+    return false;
+  }
+  entry.key.assign(path.substr(12));
+  bool include_body = method != "HEAD";
+  bool stale;
+  if (cache.get(entry.key, entry.value, &stale)) {
+    HttpResponse::write_json(conn.out, 200,
+                             {{"key", entry.key},
+                              {"status", "success"},
+                              {"value", entry.value}},
+                             keep_alive, include_body,
+                             stale ? STALE_HEADER : std::string_view());
+  } else {
+    HttpResponse::write_json(
+        conn.out, 404, {{"error", "Key not found"}, {"status", "error"}},
+        keep_alive, include_body);
+  }
+  return true;
+}
+
+bool HttpServer::handle_command(const RespCommand &command,
+                                std::string &out) {
+  const auto &args = command.args;
+  auto wrong_arity = [&]() {
+    std::string name(args[0]);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    resp::error(out, "wrong number of arguments for '" + name + "' command");
+    return true;
+  };
+
+  if (command.is("GET")) {
+    if (args.size() != 2)
+      return wrong_arity();
+    std::string value;
+    if (cache.get(std::string(args[1]), value)) {
+      resp::bulk(out, value);
+    } else {
+      resp::null(out);
+    }
+  }
+
+  else if (command.is("SET")) {
+    // SET key value [EX seconds | PX milliseconds]
+    if (args.size() != 3 && args.size() != 5)
+      return wrong_arity();
+    std::chrono::seconds ttl(0);
+    if (args.size() == 5) {
+      int64_t amount = 0;
+      auto parsed = std::from_chars(args[4].data(),
+                                    args[4].data() + args[4].size(), amount);
+      if (parsed.ec != std::errc() ||
+          parsed.ptr != args[4].data() + args[4].size() || amount <= 0) {
+        resp::error(out, "invalid expire time in 'set' command");
+        return true;
+      }
+      if (RespCommand::matches(args[3], "EX")) {
+        ttl = std::chrono::seconds(amount);
+      } else if (RespCommand::matches(args[3], "PX")) {
+        // TTLs are kept in whole seconds.
+        ttl = std::chrono::ceil<std::chrono::seconds>(
+            std::chrono::milliseconds(amount));
+      } else {
+        resp::error(out, "syntax error");
+        return true;
+      }
+      // Bounded like the HTTP ttl, so adding it to the clock cannot
+      // overflow.
+      if (ttl.count() > INT32_MAX) {
+        resp::error(out, "invalid expire time in 'set' command");
+        return true;
+      }
+    }
+    if (cache.put(std::string(args[1]), std::string(args[2]), ttl)) {
+      resp::simple(out, "OK");
+    } else {
+      resp::error(out, "failed to persist the value");
+    }
+  }
+
+  else if (command.is("DEL")) {
+    if (args.size() < 2)
+      return wrong_arity();
+    int64_t removed = 0;
+    bool failed = false;
+    for (size_t i = 1; i < args.size(); i++) {
+      removed += cache.remove(std::string(args[i]), &failed);
+    }
+    if (failed) {
+      resp::error(out, "failed to persist the delete");
+    } else {
+      resp::integer(out, removed);
+    }
+  }
+
+  else if (command.is("MGET")) {
+    if (args.size() < 2)
+      return wrong_arity();
+    std::vector<std::string> keys(args.begin() + 1, args.end());
+    auto values = cache.get_many(keys);
+    resp::array(out, values.size());
+    for (const auto &value : values) {
+      if (value) {
+        resp::bulk(out, *value);
+      } else {
+        resp::null(out);
+      }
+    }
+  }
+
+  else if (command.is("TTL")) {
+    if (args.size() != 2)
+      return wrong_arity();
+    auto ttl = cache.remaining_ttl(std::string(args[1]));
+    resp::integer(out, ttl ? ttl->count() : -2);
+  }
+
+  else if (command.is("PING")) {
+    if (args.size() > 2)
+      return wrong_arity();
+    if (args.size() == 2) {
+      resp::bulk(out, args[1]);
+    } else {
+      resp::simple(out, "PONG");
+    }
+  }
+
+  else if (command.is("COMMAND")) {
+    // redis-cli asks for command docs on connect; an empty reply is fine.
+    resp::array(out, 0);
+  }
+
+  else if (command.is("QUIT")) {
+    resp::simple(out, "OK");
+    return false;
+  }
+
+  else {
+    resp::error(out, "unknown command '" + std::string(args[0]) + "'");
+  }
+  return true;
+}
+
+HttpServer::HttpServer(int port, std::atomic<bool> &stop,
+                       const ServerConfig &config,
+                       std::unique_ptr<Storage> storage)
+    : port(port), stop_signal(stop), config(config),
+      cache(config.cache_capacity, config.cache_ttl,
+            LRUCache<std::string, std::string>::DEFAULT_SHARDS,
+            config.cache_max_bytes, std::move(storage)) {};
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+} // namespace
+
+HttpServer::Route HttpServer::route_of(std::string_view method,
+                                        std::string_view path) {
+  const bool is_get = method == "GET" || method == "HEAD";
+  if (method == "POST") {
+    if (path == "/api/cached") {
+      return Route::CACHED;
+    }
+    if (path == "/api/cached/batch") {
+      return Route::BATCH;
+    }
+    if (path == "/api/cached/batch/get") {
+      return Route::BATCH_GET;
+    }
+    if (path == "/api/cache/clear") {
+      return Route::CLEAR;
+    }
+    if (path == "/api/import") {
+      return Route::IMPORT;
+    }
+    if (path == "/api/echo") {
+      return Route::ECHO;
+    }
+  } else if (is_get) {
+    if (path.substr(0, 12) == "/api/cached/") {
+      return Route::CACHED_KEY;
+    }
+    if (path == "/api/export") {
+      return Route::EXPORT;
+    }
+    if (path == "/api/hello") {
+      return Route::HELLO;
+    }
+  }
+  return Route::OTHER;
+}
+
+// The status code of the response serialized into `out` at `from`.
+static int response_status(const std::string &out, size_t from) {
+  int status = 0;
+  // "HTTP/1.1 200 OK"
+  if (out.size() >= from + 12) {
+    std::from_chars(out.data() + from + 9, out.data() + from + 12, status);
+  }
+  return status;
+}
+
+void HttpServer::observe_request(Route route, int status,
+                                 std::chrono::steady_clock::time_point start) {
+  static constexpr const char *ROUTE_LABELS[ROUTES] = {
+      "/api/cached/{key}", "/api/cached", "/api/cached/batch",
+      "/api/cached/batch/get", "/api/cache/clear", "/api/export",
+      "/api/import", "/api/hello", "/api/echo", "other"};
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  auto known = std::find(STATUSES.begin(), STATUSES.end(), status);
+  if (known == STATUSES.end()) {
+    return;
+  }
+  auto &slot = request_durations[static_cast<size_t>(route) * STATUSES.size() +
+                                 (known - STATUSES.begin())];
+  LatencyHistogram *histogram = slot.load(std::memory_order_acquire);
+  if (!histogram) {
+    // Racing loops get the same series back from the family.
+    histogram = &cache.get_metrics()->request_durations().add(
+        {{"route", ROUTE_LABELS[static_cast<size_t>(route)]},
+         {"status", std::to_string(status)}});
+    slot.store(histogram, std::memory_order_release);
+  }
+  histogram->observe(elapsed);
+}
+
+int HttpServer::open_listener(int listen_port) {
   struct sockaddr_in address;
   address.sin_family = AF_INET;
   address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(port);
-  int addrlen = sizeof(address);
+  address.sin_port = htons(listen_port);
 
-  if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
     throw std::runtime_error("Socket creation failed");
   }
 
   int opt = 1;
-  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
-    close(server_fd);
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+    close(fd);
+    throw std::runtime_error("Setsockopt failed");
+  }
+#ifdef SO_REUSEPORT
+  // Every event loop binds its own listener and the kernel spreads incoming
+  // connections across them.
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+    close(fd);
     throw std::runtime_error("Setsockopt failed");
   }
+#endif
 
-  if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-    close(server_fd);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    close(fd);
     throw std::runtime_error("Bind failed");
   }
 
-  if (listen(server_fd, 3) < 0) {
-    close(server_fd);
+  if (listen(fd, SOMAXCONN) < 0) {
+    close(fd);
     throw std::runtime_error("Listen failed");
   }
 
-  std::cout << "Server listening on port " << port << std::endl;
+  if (!Poller::set_nonblocking(fd)) {
+    close(fd);
+    throw std::runtime_error("Listener setup failed");
+  }
+  return fd;
+}
 
-  fd_set readfds;
-  struct timeval tv;
-  tv.tv_sec = 1;
-  tv.tv_usec = 0;
+void HttpServer::close_listeners() {
+  for (int fd : listen_fds) {
+    close(fd);
+  }
+  for (int fd : resp_listen_fds) {
+    close(fd);
+  }
+  listen_fds.clear();
+  resp_listen_fds.clear();
+}
+
+void HttpServer::start() {
+  try {
+#ifdef SO_REUSEPORT
+    for (size_t i = 0; i < config.event_loops; i++) {
+      listen_fds.push_back(open_listener(port));
+      if (config.resp_port > 0) {
+        resp_listen_fds.push_back(open_listener(config.resp_port));
+      }
+    }
+#else
+    // Without SO_REUSEPORT all loops share one listener and race on accept.
+    listen_fds.push_back(open_listener(port));
+    if (config.resp_port > 0) {
+      resp_listen_fds.push_back(open_listener(config.resp_port));
+    }
+#endif
+  } catch (...) {
+    close_listeners();
+    throw;
+  }
+
+  std::cout << "Server listening on port " << port << " with "
+            << config.event_loops << " event loops" << std::endl;
+  if (config.resp_port > 0) {
+    std::cout << "RESP listening on port " << config.resp_port << std::endl;
+  }
+  // Requests are served while the warm-up runs; misses read through as
+  // usual.
+  if (config.warmup.enabled && cache.get_db() &&
+      cache.get_db()->max_connections() >= 2) {
+    warmer = std::make_unique<CacheWarmer>(cache, config.warmup,
+                                           config.cache_capacity);
+  } else if (config.warmup.enabled && cache.get_db()) {
+    std::cout << "Cache warm-up skipped: it needs a POSTGRES_POOL_SIZE of at "
+                 "least 2, to leave a connection for requests"
+              << std::endl;
+  } else if (config.warmup.enabled) {
+    std::cout << "Cache warm-up skipped: it reads from PostgreSQL"
+              << std::endl;
+  }
+
+  auto resp_fd = [this](size_t i) {
+    return resp_listen_fds.empty()
+               ? -1
+               : resp_listen_fds[i % resp_listen_fds.size()];
+  };
+  std::vector<std::thread> loops;
+  for (size_t i = 1; i < config.event_loops; i++) {
+    loops.emplace_back(&HttpServer::run_event_loop, this,
+                       listen_fds[i % listen_fds.size()], resp_fd(i));
+  }
+  run_event_loop(listen_fds[0], resp_fd(0));
+
+  for (auto &loop : loops) {
+    loop.join();
+  }
+  warmer.reset();
+  close_listeners();
+}
+
+void HttpServer::run_event_loop(int listen_fd, int resp_listen_fd) {
+  EventLoop loop(listen_fd, resp_listen_fd);
+  std::vector<Poller::Ready> ready;
+  auto last_sweep = std::chrono::steady_clock::now();
+
+  if (!loop.poller.add(listen_fd) ||
+      (resp_listen_fd >= 0 && !loop.poller.add(resp_listen_fd)) ||
+      !loop.poller.add(loop.wake_fds[0])) {
+    std::cerr << "Failed to register listener: " << strerror(errno)
+              << std::endl;
+    return;
+  }
 
   while (!stop_signal.load()) {
-    FD_ZERO(&readfds);
-    FD_SET(server_fd, &readfds);
+    if (loop.poller.wait(ready, POLL_TIMEOUT_MS) < 0) {
+      break;
+    }
 
-    int activity = select(server_fd + 1, &readfds, NULL, NULL, &tv);
+    for (const auto &event : ready) {
+      if (event.fd == listen_fd) {
+        accept_connections(loop, listen_fd, Connection::Protocol::HTTP);
+        continue;
+      }
+      if (event.fd == resp_listen_fd) {
+        accept_connections(loop, resp_listen_fd, Connection::Protocol::RESP);
+        continue;
+      }
+      if (event.fd == loop.wake_fds[0]) {
+        resume_background(loop);
+        continue;
+      }
+
+      auto it = loop.connections.find(event.fd);
+      if (it == loop.connections.end()) {
+        continue;
+      }
+      Connection &conn = it->second;
+      conn.last_active = std::chrono::steady_clock::now();
+
+      if (event.events & Poller::HANGUP) {
+        conn.peer_closed = true;
+      }
+      if (event.events & (Poller::READABLE | Poller::HANGUP)) {
+        on_readable(loop, conn);
+      }
+      if (conn.state == Connection::State::WRITING) {
+        on_writable(loop, conn);
+      }
+
+      if (conn.state == Connection::State::CLOSING ||
+          (conn.peer_closed && conn.state == Connection::State::READING)) {
+        close_connection(loop, conn);
+      }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sweep >= std::chrono::seconds(1)) {
+      close_idle_connections(loop);
+      last_sweep = now;
+    }
+  }
+
+  for (auto &entry : loop.connections) {
+    close(entry.first);
+  }
+}
+
+void HttpServer::close_connection(EventLoop &loop, Connection &conn) {
+  int fd = conn.fd;
+  // Their workers may be mid-query; let the reaper wait for them.
+  if (conn.export_stream) {
+    conn.export_stream->cancel();
+    reaper.retire(std::move(conn.export_stream));
+  }
+  if (conn.import_stream) {
+    conn.import_stream->cancel();
+    reaper.retire(std::move(conn.import_stream));
+  }
+  close(fd);
+  loop.buffers.release(std::move(conn.in));
+  loop.connections.erase(fd);
+}
+
+void HttpServer::close_idle_connections(EventLoop &loop) {
+  auto deadline = std::chrono::steady_clock::now() - config.keep_alive_timeout;
+  std::vector<int> idle;
+  for (auto &entry : loop.connections) {
+    // A paused import is waiting on its worker, not on the client.
+    if (entry.second.state != Connection::State::PAUSED &&
+        entry.second.last_active < deadline) {
+      idle.push_back(entry.first);
+    }
+  }
+  for (int fd : idle) {
+    close_connection(loop, loop.connections.at(fd));
+  }
+}
 
-    if (activity < 0) {
+void HttpServer::accept_connections(EventLoop &loop, int listen_fd,
+                                    Connection::Protocol protocol) {
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
       if (errno == EINTR)
         continue;
-      break;
+      // EAGAIN: backlog drained, or another loop won the race.
+      return;
     }
 
-    if (activity == 0)
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt));
+#endif
+
+    if (!Poller::set_nonblocking(fd) || !loop.poller.add(fd)) {
+      close(fd);
       continue;
+    }
+    loop.connections.emplace(fd, Connection(fd, protocol, loop.buffers.acquire(),
+                                            config.max_body_size));
+  }
+}
 
-    if (FD_ISSET(server_fd, &readfds)) {
-      int new_socket =
-          accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen);
-      if (new_socket < 0)
-        continue;
+void HttpServer::on_readable(EventLoop &loop, Connection &conn) {
+  while (conn.state == Connection::State::READING) {
+    // Once the headers announce the body size, make room for all of it at
+    // once rather than growing the buffer read by read.
+    size_t room = BUFFER_SIZE;
+    size_t needed = conn.protocol == Connection::Protocol::RESP
+                        ? conn.resp_parser.bytes_needed()
+                        : conn.parser.bytes_needed();
+    if (needed > conn.in.size()) {
+      room = std::max(room, needed - conn.in.size());
+    }
+    char *dest = conn.in.prepare(room);
+    ssize_t n = recv(conn.fd, dest, conn.in.writable(), 0);
+
+    if (n > 0) {
+      conn.in.commit(n);
+      conn.received = std::chrono::steady_clock::now();
+      process_requests(loop, conn);
+    } else if (n == 0) {
+      conn.peer_closed = true;
+      return;
+    } else if (errno == EINTR) {
+      continue;
+    } else {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        conn.state = Connection::State::CLOSING;
+      }
+      return;
+    }
+  }
+}
 
-      char buffer[BUFFER_SIZE] = {0};
-      read(new_socket, buffer, BUFFER_SIZE);
-      std::string response = handle_request(buffer);
-      send(new_socket, response.c_str(), response.length(), 0);
-      close(new_socket);
+void HttpServer::process_requests(EventLoop &loop, Connection &conn) {
+  if (conn.protocol == Connection::Protocol::RESP) {
+    process_commands(conn);
+    return;
+  }
+  if (conn.import_stream) {
+    feed_import(conn);
+    return;
+  }
+  while (!conn.close_after_write && !conn.in.empty()) {
+    HttpParser::Status status =
+        conn.parser.parse(conn.in.data(), conn.in.size(), conn.request);
+
+    if (status == HttpParser::Status::INCOMPLETE) {
+      break;
     }
+    conn.request_start = conn.received;
+    if (status == HttpParser::Status::HEADERS) {
+      if (conn.request.method == "POST" &&
+          conn.request.path == "/api/import") {
+        start_import(loop, conn);
+        return;
+      }
+      continue;
+    }
+    if (status == HttpParser::Status::ERROR) {
+      int code = conn.parser.error_status();
+      json error = {{"error", HttpResponse::status_text(code)},
+                    {"status", "error"}};
+      HttpResponse(code, error.dump()).serialize(conn.out, false);
+      observe_request(route_of(conn.request.method, conn.request.path), code,
+                      conn.request_start);
+      conn.close_after_write = true;
+      break;
+    }
+
+    bool keep_alive =
+        conn.request.keep_alive &&
+        ++conn.requests_served < config.max_requests_per_connection;
+    const std::string_view method = conn.request.method;
+    Route route = route_of(method, conn.request.path);
+    size_t response_at = conn.out.size();
+    if (route == Route::EXPORT) {
+      start_export(loop, conn, keep_alive);
+      keep_alive = keep_alive && conn.request.version != "HTTP/1.0";
+    } else if (!handle_fast(conn, keep_alive)) {
+      handle_request(conn.request)
+          .serialize(conn.out, keep_alive, method != "HEAD");
+    }
+    conn.close_after_write = !keep_alive;
+    if (!conn.export_stream) { // else timed when the stream ends
+      observe_request(route, response_status(conn.out, response_at),
+                      conn.request_start);
+    }
+
+    conn.in.consume(conn.parser.consumed());
+    conn.parser.reset();
+    if (conn.export_stream) {
+      conn.state = Connection::State::WRITING;
+      return;
+    }
+  }
+
+  if (conn.close_after_write) {
+    conn.in.clear();
+  }
+  if (!conn.out.empty()) {
+    conn.state = Connection::State::WRITING;
   }
-  close(server_fd);
 }
 
-std::string HttpServer::export_cache_data() {
-  try {
-    // Get current timestamp as string
-    auto now = std::chrono::system_clock::now();
-    auto now_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ts;
-    ts << std::put_time(std::localtime(&now_t), "%Y-%m-%d %H:%M:%S");
+void HttpServer::process_commands(Connection &conn) {
+  while (!conn.close_after_write && !conn.in.empty()) {
+    RespParser::Status status =
+        conn.resp_parser.parse(conn.in.data(), conn.in.size(), conn.command);
 
-    // Create the export data JSON
-    json export_data = {{"timestamp", ts.str()}, {"entries", json::array()}};
+    if (status == RespParser::Status::INCOMPLETE) {
+      break;
+    }
+    if (status == RespParser::Status::ERROR) {
+      resp::error(conn.out, conn.resp_parser.error_message());
+      conn.close_after_write = true;
+      break;
+    }
 
-    // Get database connection through cache
-    DatabaseConnection *db = cache.get_db();
-    if (!db) {
-      throw std::runtime_error("Database connection not available");
+    if (!conn.command.args.empty() &&
+        !handle_command(conn.command, conn.out)) {
+      conn.close_after_write = true;
     }
+    conn.in.consume(conn.resp_parser.consumed());
+    conn.resp_parser.reset();
+  }
 
-    pqxx::work txn(*db->get_connection());
+  if (conn.close_after_write) {
+    conn.in.clear();
+  }
+  if (!conn.out.empty()) {
+    conn.state = Connection::State::WRITING;
+  }
+}
 
-    auto result = txn.exec("SELECT key, value, expiry, created_at "
-                           "FROM cache_entries "
-                           "WHERE expiry > CURRENT_TIMESTAMP");
+void HttpServer::on_writable(EventLoop &loop, Connection &conn) {
+  while (conn.state == Connection::State::WRITING) {
+    while (conn.out_offset < conn.out.size()) {
+      ssize_t n = send(conn.fd, conn.out.data() + conn.out_offset,
+                       conn.out.size() - conn.out_offset, SEND_FLAGS);
+      if (n > 0) {
+        conn.out_offset += n;
+      } else if (n < 0 && errno == EINTR) {
+        continue;
+      } else {
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+          conn.state = Connection::State::CLOSING;
+        }
+        return;
+      }
+    }
 
-    for (const auto &row : result) {
-      export_data["entries"].push_back(
-          {{"key", row[0].as<std::string>()},
-           {"value", row[1].as<std::string>()},
-           {"expiry", row[2].as<std::string>()},
-           {"created_at", row[3].as<std::string>()}});
+    conn.out.clear();
+    conn.out_offset = 0;
+    if (conn.export_stream) {
+      // Only refill once the socket has taken everything, so a slow reader
+      // holds the producer back instead of growing conn.out.
+      ExportStream::Status status = conn.export_stream->take(conn.out);
+      if (status == ExportStream::Status::PENDING) {
+        return; // resumed by resume_background()
+      }
+      int code = 200;
+      if (status == ExportStream::Status::FAILED) {
+        if (conn.export_stream->has_started()) {
+          conn.close_after_write = true; // no terminating chunk
+        } else {
+          json error = {{"error", "Export failed: " +
+                                      conn.export_stream->error_message()},
+                        {"status", "error"}};
+          HttpResponse(500, error.dump())
+              .serialize(conn.out, !conn.close_after_write);
+          code = 500;
+        }
+      }
+      if (status != ExportStream::Status::DATA) {
+        observe_request(Route::EXPORT, code, conn.request_start);
+        conn.export_stream.reset();
+      }
+      continue;
+    }
+    if (conn.close_after_write) {
+      conn.state = Connection::State::CLOSING;
+      return;
     }
 
-    txn.commit();
+    // Requests that arrived while we were writing produced no further edge,
+    // so pick them up now.
+    conn.state = Connection::State::READING;
+    process_requests(loop, conn);
+    if (conn.state == Connection::State::READING) {
+      on_readable(loop, conn);
+    }
+  }
+}
 
-    return "HTTP/1.1 200 OK\r\n"
-           "Content-Type: application/json\r\n"
-           "Content-Disposition: attachment; "
-           "filename=cache_export.json\r\n\r\n" +
-           export_data.dump(2);
-  } catch (const std::exception &e) {
-    json error = {{"error", "Export failed: " + std::string(e.what())},
-                  {"status", "error"}};
-    return "HTTP/1.1 500 Internal Server Error\r\n"
-           "Content-Type: application/json\r\n\r\n" +
-           error.dump();
+void HttpServer::start_export(EventLoop &loop, Connection &conn,
+                              bool keep_alive) {
+  const HttpRequest &request = conn.request;
+  bool ndjson = request.query.find("format=ndjson") != std::string_view::npos;
+  // HTTP/1.0 clients cannot read chunks; their body ends when we close.
+  bool chunked = request.version != "HTTP/1.0";
+
+  std::string extra_headers = ndjson ? "Content-Disposition: attachment; "
+                                       "filename=cache_export.ndjson\r\n"
+                                     : "Content-Disposition: attachment; "
+                                       "filename=cache_export.json\r\n";
+  if (chunked) {
+    extra_headers += "Transfer-Encoding: chunked\r\n";
+  }
+  std::string head;
+  HttpResponse::serialize_head(
+      head, 200, ndjson ? "application/x-ndjson" : "application/json",
+      HttpResponse::STREAMED, keep_alive && chunked, extra_headers);
+  if (request.method == "HEAD") {
+    conn.out += head;
+    return;
+  }
+
+  auto now_t = std::chrono::system_clock::to_time_t(
+      std::chrono::system_clock::now());
+  std::stringstream ts;
+  ts << std::put_time(std::localtime(&now_t), "%Y-%m-%d %H:%M:%S");
+
+  int fd = conn.fd;
+  conn.export_stream = std::make_unique<ExportStream>(
+      cache.get_db(),
+      ndjson ? ExportStream::Format::NDJSON : ExportStream::Format::JSON,
+      std::move(head), ts.str(), chunked,
+      [&loop, fd]() { loop.wake(fd); });
+}
+
+void HttpServer::start_import(EventLoop &loop, Connection &conn) {
+  const HttpRequest &request = conn.request;
+  conn.close_after_write =
+      !request.keep_alive ||
+      ++conn.requests_served >= config.max_requests_per_connection;
+
+  // The body is read as it streams in, so it needs a known length.
+  if (conn.parser.chunked_body()) {
+    HttpResponse::write_json(
+        conn.out, 411, {{"error", "Length Required"}, {"status", "error"}},
+        false);
+    observe_request(Route::IMPORT, 411, conn.request_start);
+    conn.close_after_write = true;
+    conn.in.clear();
+    conn.state = Connection::State::WRITING;
+    return;
+  }
+
+  bool warm = request.query.find("warm=false") == std::string_view::npos;
+  conn.in.consume(conn.parser.header_bytes());
+  conn.import_remaining = conn.parser.body_length();
+  int fd = conn.fd;
+  conn.import_stream = std::make_unique<ImportStream>(
+      cache, warm, [&loop, fd]() { loop.wake(fd); }, config.max_body_size);
+  feed_import(conn);
+}
+
+void HttpServer::feed_import(Connection &conn) {
+  size_t available = std::min(conn.in.size(), conn.import_remaining);
+  size_t taken =
+      available > 0 ? conn.import_stream->feed(conn.in.data(), available) : 0;
+  conn.in.consume(taken);
+  conn.import_remaining -= taken;
+
+  if (conn.import_remaining == 0) {
+    conn.import_stream->finish_input();
+    conn.state = Connection::State::PAUSED; // until the worker finishes
+  } else if (taken < available) {
+    conn.state = Connection::State::PAUSED; // until the worker has room
+  } else {
+    conn.state = Connection::State::READING;
+  }
+}
+
+void HttpServer::finish_import(EventLoop &loop, Connection &conn) {
+  const ImportStream::Result &result = conn.import_stream->outcome();
+  // Body bytes left unread would be taken for the next request.
+  if (conn.import_remaining > 0 || !result.error.empty()) {
+    conn.close_after_write = true;
+  }
+  bool keep_alive = !conn.close_after_write;
+  auto imported = static_cast<int64_t>(result.imported);
+  if (result.error.empty()) {
+    HttpResponse::write_json(
+        conn.out, 200,
+        {{"expired", static_cast<int64_t>(result.expired)},
+         {"imported", imported},
+         {"invalid", static_cast<int64_t>(result.invalid)},
+         {"message", "Import complete"},
+         {"status", "success"}},
+        keep_alive);
+  } else {
+    HttpResponse::write_json(conn.out, 500,
+                             {{"error", "Import failed: " + result.error},
+                              {"imported", imported},
+                              {"status", "error"}},
+                             keep_alive);
+  }
+  observe_request(Route::IMPORT, result.error.empty() ? 200 : 500,
+                  conn.request_start);
+  conn.import_stream.reset();
+  conn.import_remaining = 0;
+  conn.parser.reset();
+  conn.state = Connection::State::WRITING;
+  on_writable(loop, conn);
+}
+
+void HttpServer::resume_background(EventLoop &loop) {
+  char drain[64];
+  while (read(loop.wake_fds[0], drain, sizeof(drain)) > 0) {
+  }
+  std::vector<int> ready;
+  {
+    std::lock_guard<std::mutex> lock(loop.woken_mutex);
+    ready.swap(loop.woken);
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  for (int fd : ready) {
+    auto it = loop.connections.find(fd);
+    // The connection may have closed, or its fd been reused, since.
+    if (it == loop.connections.end()) {
+      continue;
+    }
+    Connection &conn = it->second;
+    if (conn.export_stream) {
+      conn.last_active = now;
+      on_writable(loop, conn);
+    } else if (conn.import_stream) {
+      conn.last_active = now;
+      if (conn.import_stream->done()) {
+        finish_import(loop, conn);
+      } else if (conn.state == Connection::State::PAUSED &&
+                 conn.import_remaining > 0) {
+        feed_import(conn);
+        if (conn.state == Connection::State::READING) {
+          on_readable(loop, conn);
+        }
+      }
+    } else {
+      continue;
+    }
+    if (conn.state == Connection::State::CLOSING ||
+        (conn.peer_closed && conn.state == Connection::State::READING)) {
+      close_connection(loop, conn);
+    }
   }
 }
 
-HttpServer::~HttpServer() { close(server_fd); }
+HttpServer::~HttpServer() { close_listeners(); }
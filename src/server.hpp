@@ -1,40 +1,364 @@
 #ifndef SERVER_HPP
 #define SERVER_HPP
 
+#include "buffer_pool.hpp"
 #include "cache.hpp"
 #include "database.hpp"
+#include "export_stream.hpp"
+#include "http_parser.hpp"
+#include "import_stream.hpp"
+#include "json_fast.hpp"
+#include "latency.hpp"
+#include "poller.hpp"
+#include "reaper.hpp"
+#include "resp.hpp"
+#include "warmup.hpp"
+#include <array>
 #include <atomic>
+#include <charconv>
 #include <chrono>
 #include <cstring>
+#include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <map>
 #include <mutex>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <string>
+#include <strings.h>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
 using json = nlohmann::json;
 
+struct ServerConfig {
+  // Number of event loops, each on its own thread with its own listener.
+  size_t event_loops = std::max(1u, std::thread::hardware_concurrency());
+  // Persistent connections are closed after this long without traffic.
+  std::chrono::seconds keep_alive_timeout = std::chrono::seconds(15);
+  // Requests served on one connection before it is closed.
+  size_t max_requests_per_connection = 1000;
+  // Largest request body accepted; bigger requests get 413.
+  size_t max_body_size = 4 * 1024 * 1024;
+  // Entries kept in memory; 0 leaves only the byte budget.
+  size_t cache_capacity = 1024;
+  // Bytes charged for in-memory entries (key + value + overhead); 0 means
+  // unlimited. Size this below the container's memory limit.
+  size_t cache_max_bytes = 0;
+  // TTL for entries written without one.
+  std::chrono::seconds cache_ttl = std::chrono::seconds(300);
+  // Port for Redis protocol (RESP) clients, served by the same event loops
+  // and cache; 0 disables it.
+  int resp_port = 0;
+  // Preloading the cache from PostgreSQL in the background at startup.
+  WarmupConfig warmup;
+
+  static ServerConfig from_env() {
+    ServerConfig config;
+    if (const char *loops = std::getenv("SERVER_EVENT_LOOPS")) {
+      config.event_loops = std::max(1L, std::strtol(loops, nullptr, 10));
+    }
+    if (const char *timeout = std::getenv("SERVER_KEEPALIVE_TIMEOUT")) {
+      config.keep_alive_timeout =
+          std::chrono::seconds(std::max(1L, std::strtol(timeout, nullptr, 10)));
+    }
+    if (const char *max = std::getenv("SERVER_KEEPALIVE_REQUESTS")) {
+      config.max_requests_per_connection =
+          std::max(1L, std::strtol(max, nullptr, 10));
+    }
+    if (const char *body = std::getenv("SERVER_MAX_BODY_SIZE")) {
+      config.max_body_size = std::strtoul(body, nullptr, 10);
+    }
+    if (const char *capacity = std::getenv("CACHE_CAPACITY")) {
+      config.cache_capacity = std::strtoul(capacity, nullptr, 10);
+    }
+    if (const char *bytes = std::getenv("CACHE_MAX_BYTES")) {
+      config.cache_max_bytes = std::strtoul(bytes, nullptr, 10);
+    }
+    if (const char *ttl = std::getenv("CACHE_TTL")) {
+      config.cache_ttl =
+          std::chrono::seconds(std::max(1L, std::strtol(ttl, nullptr, 10)));
+    }
+    if (const char *resp = std::getenv("SERVER_RESP_PORT")) {
+      config.resp_port = std::strtol(resp, nullptr, 10);
+    }
+    config.warmup = WarmupConfig::from_env();
+    return config;
+  }
+};
+
+// Marks a value served past its expiry while the cache reloads it (see
+// CACHE_SERVE_STALE_SECS).
+inline constexpr std::string_view STALE_HEADER = "X-Cache-Stale: true\r\n";
+
+struct HttpResponse {
+  int status = 200;
+  std::string body;
+  std::string content_type = "application/json";
+  // Preformatted "Name: value\r\n" lines appended after the standard headers.
+  std::string extra_headers;
+
+  HttpResponse() = default;
+  HttpResponse(int status, std::string body)
+      : status(status), body(std::move(body)) {}
+
+  static const char *status_text(int status) {
+    switch (status) {
+    case 200:
+      return "OK";
+    case 400:
+      return "Bad Request";
+    case 404:
+      return "Not Found";
+    case 408:
+      return "Request Timeout";
+    case 411:
+      return "Length Required";
+    case 413:
+      return "Payload Too Large";
+    case 431:
+      return "Request Header Fields Too Large";
+    case 500:
+      return "Internal Server Error";
+    case 501:
+      return "Not Implemented";
+    default:
+      return "Unknown";
+    }
+  }
+
+  // Passed as the content length of a streamed body, which is then framed
+  // by the caller: chunked, or by closing the connection.
+  static const size_t STREAMED = SIZE_MAX;
+
+  static void serialize_head(std::string &out, int status,
+                             std::string_view content_type,
+                             size_t content_length, bool keep_alive,
+                             std::string_view extra_headers = {}) {
+    out += "HTTP/1.1 ";
+    out += std::to_string(status);
+    out += ' ';
+    out += status_text(status);
+    out += "\r\nContent-Type: ";
+    out += content_type;
+    if (content_length != STREAMED) {
+      out += "\r\nContent-Length: ";
+      out += std::to_string(content_length);
+    }
+    out += keep_alive ? "\r\nConnection: keep-alive\r\n"
+                      : "\r\nConnection: close\r\n";
+    out += extra_headers;
+    out += "\r\n";
+  }
+
+  // Appends the full response to `out`, framed by Content-Length so the
+  // connection can carry further requests. HEAD responses omit the body.
+  void serialize(std::string &out, bool keep_alive,
+                 bool include_body = true) const {
+    serialize_head(out, status, content_type, body.size(), keep_alive,
+                   extra_headers);
+    if (include_body) {
+      out += body;
+    }
+  }
+
+  // Same framing for a flat JSON object, escaped straight into `out`
+  // without building a body first.
+  static void write_json(std::string &out, int status,
+                         std::initializer_list<json_fast::Field> fields,
+                         bool keep_alive, bool include_body = true,
+                         std::string_view extra_headers = {}) {
+    serialize_head(out, status, "application/json",
+                   json_fast::object_size(fields), keep_alive, extra_headers);
+    if (include_body) {
+      json_fast::append_object(out, fields);
+    }
+  }
+};
+
 class HttpServer {
 private:
-  int server_fd;
+  // Per-connection state machine driven by its event loop. Pipelined
+  // requests are answered in order; reading pauses while responses are
+  // still being written, and while an import waits on its worker (PAUSED).
+  struct Connection {
+    enum class State { READING, WRITING, PAUSED, CLOSING };
+    enum class Protocol { HTTP, RESP };
+
+    int fd;
+    Protocol protocol;
+    State state = State::READING;
+    IoBuffer in;
+    std::string out;
+    size_t out_offset = 0;
+    HttpParser parser;
+    HttpRequest request;
+    RespParser resp_parser;
+    RespCommand command;
+    // Reused by the fast routes so steady-state requests do not allocate.
+    json_fast::CacheEntryRequest entry;
+    std::string scratch;
+    // Set while a GET /api/export body is being sent; later pipelined
+    // requests wait until it finishes.
+    std::unique_ptr<ExportStream> export_stream;
+    // Set while a POST /api/import body is being loaded, with the body
+    // bytes not yet fed to it.
+    std::unique_ptr<ImportStream> import_stream;
+    size_t import_remaining = 0;
+    size_t requests_served = 0;
+    bool close_after_write = false;
+    bool peer_closed = false;
+    std::chrono::steady_clock::time_point last_active;
+    // When the last read arrived, and when the request being answered was
+    // read; exports and imports are timed from it until they finish.
+    std::chrono::steady_clock::time_point received;
+    std::chrono::steady_clock::time_point request_start;
+
+    Connection(int fd, Protocol protocol, IoBuffer in, size_t max_body_bytes)
+        : fd(fd), protocol(protocol), in(std::move(in)),
+          parser(MAX_HEADER_BYTES, max_body_bytes),
+          resp_parser(max_body_bytes),
+          last_active(std::chrono::steady_clock::now()) {
+      parser.set_report_headers(true);
+    }
+  };
+
+  // State owned by a single event loop thread.
+  struct EventLoop {
+    int listen_fd;
+    int resp_listen_fd; // -1 when RESP is disabled
+    Poller poller;
+    std::unordered_map<int, Connection> connections;
+    BufferPool buffers;
+    // Export and import workers queue their connection's fd and write a
+    // byte to the pipe, which the loop polls like a socket, to have it
+    // resume the connection.
+    int wake_fds[2];
+    std::mutex woken_mutex;
+    std::vector<int> woken;
+
+    EventLoop(int listen_fd, int resp_listen_fd)
+        : listen_fd(listen_fd), resp_listen_fd(resp_listen_fd),
+          buffers(BUFFER_SIZE, MAX_POOLED_BUFFERS, MAX_POOLED_CAPACITY) {
+      if (pipe(wake_fds) != 0 || !Poller::set_nonblocking(wake_fds[0]) ||
+          !Poller::set_nonblocking(wake_fds[1])) {
+        throw std::runtime_error("Wake pipe creation failed: " +
+                                 std::string(strerror(errno)));
+      }
+    }
+
+    // Workers are joined with their connections before the pipe closes.
+    ~EventLoop() {
+      connections.clear();
+      close(wake_fds[0]);
+      close(wake_fds[1]);
+    }
+
+    // Called from worker threads.
+    void wake(int fd) {
+      bool ring;
+      {
+        std::lock_guard<std::mutex> lock(woken_mutex);
+        ring = woken.empty();
+        woken.push_back(fd);
+      }
+      if (ring) {
+        // A full pipe already holds an unread wake-up.
+        ssize_t ignored = write(wake_fds[1], "", 1);
+        (void)ignored;
+      }
+    }
+  };
+
   int port;
   std::atomic<bool> &stop_signal;
-  static const int BUFFER_SIZE = 1024;
+  ServerConfig config;
+  std::vector<int> listen_fds;
+  std::vector<int> resp_listen_fds;
+  // Initial read buffer size, and the least room offered to each read.
+  static const size_t BUFFER_SIZE = 16 * 1024;
+  static const size_t MAX_HEADER_BYTES = 8192;
+  static const size_t MAX_POOLED_BUFFERS = 64;
+  static const size_t MAX_POOLED_CAPACITY = 1024 * 1024;
+  static const int POLL_TIMEOUT_MS = 100;
   LRUCache<std::string, std::string> cache;
+  // Runs while the listeners are open; declared after the cache it fills.
+  std::unique_ptr<CacheWarmer> warmer;
+  // Finishes the exports and imports of closed connections off the event
+  // loops; declared after the cache their workers use.
+  Reaper reaper;
+
+  // Labels of cache_http_request_duration_seconds. Keys are folded into
+  // route templates so they never become label values.
+  enum class Route {
+    CACHED_KEY,
+    CACHED,
+    BATCH,
+    BATCH_GET,
+    CLEAR,
+    EXPORT,
+    IMPORT,
+    HELLO,
+    ECHO,
+    OTHER,
+  };
+  static constexpr size_t ROUTES = static_cast<size_t>(Route::OTHER) + 1;
+  // The codes HttpResponse::status_text() knows.
+  static constexpr std::array<int, 9> STATUSES = {200, 400, 404, 408, 411,
+                                                  413, 431, 500, 501};
+  // Request latency series by route and status, created on first use.
+  std::array<std::atomic<LatencyHistogram *>, ROUTES * STATUSES.size()>
+      request_durations{};
+
+  static Route route_of(std::string_view method, std::string_view path);
+  // Records a request read at `start` whose response is now queued.
+  void observe_request(Route route, int status,
+                       std::chrono::steady_clock::time_point start);
+
+  HttpResponse handle_request(const HttpRequest &request);
+  // Answers GET /api/cached/{key} and well-formed POST /api/cached without
+  // a JSON DOM, writing the response straight into conn.out. Returns false
+  // to leave the request to handle_request(), which serves every route.
+  bool handle_fast(Connection &conn, bool keep_alive);
+  // Executes one RESP command, appending its reply. Returns false if the
+  // connection should close after the reply is written.
+  bool handle_command(const RespCommand &command, std::string &out);
 
-  std::string handle_request(const std::string &request);
-  std::string export_cache_data();
+  int open_listener(int port);
+  void close_listeners();
+  void run_event_loop(int listen_fd, int resp_listen_fd);
+  void accept_connections(EventLoop &loop, int listen_fd,
+                          Connection::Protocol protocol);
+  void close_connection(EventLoop &loop, Connection &conn);
+  void close_idle_connections(EventLoop &loop);
+  // Starts streaming GET /api/export on a producer thread; see ExportStream.
+  void start_export(EventLoop &loop, Connection &conn, bool keep_alive);
+  // Takes over the body of POST /api/import once its headers are parsed;
+  // see ImportStream.
+  void start_import(EventLoop &loop, Connection &conn);
+  void feed_import(Connection &conn);
+  void finish_import(EventLoop &loop, Connection &conn);
+  // Resumes connections whose export or import worker woke the loop.
+  void resume_background(EventLoop &loop);
+  void on_readable(EventLoop &loop, Connection &conn);
+  void on_writable(EventLoop &loop, Connection &conn);
+  void process_requests(EventLoop &loop, Connection &conn);
+  void process_commands(Connection &conn);
 
 public:
+  // Without `storage`, the cache opens the one StorageConfig::from_env()
+  // selects.
   HttpServer(int port = 8080,
-             std::atomic<bool> &stop = *new std::atomic<bool>(false));
+             std::atomic<bool> &stop = *new std::atomic<bool>(false),
+             const ServerConfig &config = ServerConfig::from_env(),
+             std::unique_ptr<Storage> storage = nullptr);
   void start();
   ~HttpServer();
 };
@@ -0,0 +1,109 @@
+#ifndef STORAGE_HPP
+#define STORAGE_HPP
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct CacheRow {
+  std::string key;
+  std::string value;
+  std::chrono::system_clock::time_point expiry;
+  bool deleted = false; // remove the key instead of upserting it
+};
+
+enum class StorageBackend {
+  // PostgreSQL through DatabaseConnection; required for export, import and
+  // the startup warm-up.
+  POSTGRES,
+  // Files on local disk through LocalStore: a memory-mapped snapshot plus
+  // an append-only log.
+  LOCAL,
+  // Nothing: a pure in-memory cache through NullStorage. Entries are lost
+  // on restart and a miss is just a miss.
+  NONE,
+};
+
+struct StorageConfig {
+  StorageBackend backend = StorageBackend::POSTGRES;
+
+  static StorageConfig from_env() {
+    StorageConfig config;
+    if (const char *backend = std::getenv("CACHE_STORAGE")) {
+      config.backend = strcmp(backend, "local") == 0  ? StorageBackend::LOCAL
+                       : strcmp(backend, "none") == 0 ? StorageBackend::NONE
+                                                      : StorageBackend::POSTGRES;
+    }
+    return config;
+  }
+};
+
+// Where the cache persists its entries and reads misses from. Expiries are
+// absolute, so an entry keeps its remaining TTL across restarts. Every
+// method is called from several threads at once.
+class Storage {
+public:
+  virtual ~Storage() = default;
+
+  // Returns false if the write failed; the caller retries.
+  virtual bool put(const std::string &key, const std::string &value,
+                   const std::chrono::system_clock::time_point &expiry) = 0;
+
+  // Applies all rows together. Keys must be unique within the batch.
+  virtual bool put_many(const std::vector<CacheRow> &rows) = 0;
+
+  // Sets `remaining_ttl`, when given, to the whole seconds the entry has
+  // left to live. A failed lookup also returns nullopt, and sets `failed`
+  // when given, so the caller can tell it from a missing entry.
+  virtual std::optional<std::string>
+  get(const std::string &key, std::chrono::seconds *remaining_ttl = nullptr,
+      bool *failed = nullptr) = 0;
+
+  // The live entries among `keys`, in no particular order; sets `failed`,
+  // when given, if the lookup failed.
+  virtual std::vector<CacheRow>
+  get_many(const std::vector<std::string> &keys, bool *failed = nullptr) = 0;
+
+  // Drops expired entries; the cache calls this every few minutes.
+  virtual void cleanup_expired() = 0;
+
+  // False while the backend cannot serve yet, such as PostgreSQL still
+  // connecting. The cache then answers from memory alone and does not
+  // remember its misses as absent.
+  virtual bool ready() const { return true; }
+
+  // False if the backend keeps nothing, so the cache need not queue writes
+  // for it.
+  virtual bool persistent() const { return true; }
+};
+
+// Storage that keeps nothing, for running as a pure cache.
+class NullStorage : public Storage {
+public:
+  bool put(const std::string &, const std::string &,
+           const std::chrono::system_clock::time_point &) override {
+    return true;
+  }
+
+  bool put_many(const std::vector<CacheRow> &) override { return true; }
+
+  std::optional<std::string> get(const std::string &,
+                                 std::chrono::seconds * = nullptr,
+                                 bool * = nullptr) override {
+    return std::nullopt;
+  }
+
+  std::vector<CacheRow> get_many(const std::vector<std::string> &,
+                                 bool * = nullptr) override {
+    return {};
+  }
+
+  void cleanup_expired() override {}
+
+  bool persistent() const override { return false; }
+};
+
+#endif
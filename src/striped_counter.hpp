@@ -0,0 +1,108 @@
+#ifndef STRIPED_COUNTER_HPP
+#define STRIPED_COUNTER_HPP
+
+#include <prometheus/collectable.h>
+#include <prometheus/metric_family.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Cells per striped metric. Threads beyond this share cells, which stays
+// correct and only brings back some of the contention.
+constexpr size_t METRIC_STRIPES = 16;
+
+// The cell this thread records into; threads take cells in the order they
+// first record.
+inline size_t metric_stripe() {
+  static std::atomic<size_t> next{0};
+  thread_local size_t stripe =
+      next.fetch_add(1, std::memory_order_relaxed) % METRIC_STRIPES;
+  return stripe;
+}
+
+// A counter for the request path. prometheus::Counter is a single atomic
+// that every core increments, so its cache line moves between cores on
+// each request; here each thread increments its own cache-line-sized cell
+// and the cells are only summed when read.
+class StripedCounter {
+private:
+  struct alignas(64) Cell {
+    std::atomic<uint64_t> value{0};
+  };
+  std::unique_ptr<Cell[]> cells;
+
+public:
+  StripedCounter() : cells(new Cell[METRIC_STRIPES]) {}
+
+  void increment(uint64_t n = 1) {
+    cells[metric_stripe()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  uint64_t value() const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < METRIC_STRIPES; i++) {
+      total += cells[i].value.load(std::memory_order_relaxed);
+    }
+    return total;
+  }
+};
+
+// A counter or gauge family whose values are read when Prometheus scrapes
+// instead of being pushed on every change. Each series is a function
+// returning its current value; it must stay callable until the exposer it
+// is registered with is destroyed.
+class ScrapedFamily : public prometheus::Collectable {
+public:
+  using Reader = std::function<double()>;
+
+private:
+  std::string name;
+  std::string help;
+  prometheus::MetricType type;
+  mutable std::mutex mutex; // guards `series`
+  std::vector<std::pair<prometheus::Labels, Reader>> series;
+
+public:
+  // `type` is MetricType::Counter or MetricType::Gauge.
+  ScrapedFamily(std::string name, std::string help,
+                prometheus::MetricType type)
+      : name(std::move(name)), help(std::move(help)), type(type) {}
+
+  void add(const prometheus::Labels &labels, Reader reader) {
+    std::lock_guard<std::mutex> lock(mutex);
+    series.emplace_back(labels, std::move(reader));
+  }
+
+  // Adds a series reading `counter`, which must outlive the family.
+  void add(const prometheus::Labels &labels, const StripedCounter &counter) {
+    add(labels, [&counter]() { return static_cast<double>(counter.value()); });
+  }
+
+  std::vector<prometheus::MetricFamily> Collect() const override {
+    prometheus::MetricFamily family;
+    family.name = name;
+    family.help = help;
+    family.type = type;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &[labels, reader] : series) {
+      prometheus::ClientMetric metric;
+      for (const auto &[label, value] : labels) {
+        metric.label.push_back({label, value});
+      }
+      if (type == prometheus::MetricType::Counter) {
+        metric.counter.value = reader();
+      } else {
+        metric.gauge.value = reader();
+      }
+      family.metric.push_back(std::move(metric));
+    }
+    return {family};
+  }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+
+// Hierarchical timing wheel over integer ticks. Level L has 64 slots of
+// 64^L ticks each, so a timer lives in the coarsest slot that still
+// separates it from the current tick and is cascaded into finer levels as
+// time catches up. Scheduling and cancelling are O(1).
+//
+// advance() is incremental: slots that come due are queued and drained at
+// most `budget` timers per call, so a caller holding a lock can bound how
+// long it holds it and resume on the next call. Not thread-safe.
+template <typename T> class TimerWheel {
+private:
+  static const int LEVEL_BITS = 6;
+  static const size_t SLOTS = size_t(1) << LEVEL_BITS;
+  static const int LEVELS = 5; // 2^30 ticks before timers park in overflow
+  static const uint8_t PENDING = LEVELS;
+  static const uint8_t OVERFLOW = LEVELS + 1;
+
+  struct Timer {
+    T item;
+    uint64_t expiry;
+    uint8_t level;
+    uint8_t slot;
+  };
+  using TimerList = std::list<Timer>;
+
+  TimerList slots[LEVELS][SLOTS];
+  TimerList pending;  // already due when scheduled
+  TimerList overflow; // beyond the top level, re-placed as it wraps
+  uint64_t current = 0;
+  size_t count = 0;
+
+  // Slots reached by `current` that still hold timers to fire or cascade.
+  TimerList *due[LEVELS];
+  size_t due_count = 0;
+  size_t overflow_due = 0;
+
+  TimerList &list_for(const Timer &timer) {
+    if (timer.level == PENDING)
+      return pending;
+    if (timer.level == OVERFLOW)
+      return overflow;
+    return slots[timer.level][timer.slot];
+  }
+
+  // Moves a timer from wherever it is to the slot matching its expiry.
+  // Timers from a due level-L slot always land below L, so draining a slot
+  // never refills it.
+  void place(typename TimerList::iterator timer) {
+    TimerList &from = list_for(*timer);
+    if (timer->expiry <= current) {
+      timer->level = PENDING;
+      pending.splice(pending.end(), from, timer);
+      return;
+    }
+    for (int level = 0; level < LEVELS; level++) {
+      int shift = LEVEL_BITS * (level + 1);
+      if ((timer->expiry >> shift) == (current >> shift)) {
+        timer->level = level;
+        timer->slot = (timer->expiry >> (LEVEL_BITS * level)) & (SLOTS - 1);
+        TimerList &to = slots[level][timer->slot];
+        to.splice(to.end(), from, timer);
+        return;
+      }
+    }
+    timer->level = OVERFLOW;
+    overflow.splice(overflow.end(), from, timer);
+  }
+
+  template <typename Fn>
+  void fire_or_place(typename TimerList::iterator timer, Fn &expire) {
+    if (timer->expiry > current) {
+      place(timer);
+      return;
+    }
+    T item = timer->item;
+    list_for(*timer).erase(timer);
+    count--;
+    expire(item);
+  }
+
+public:
+  using Handle = typename TimerList::iterator;
+
+  explicit TimerWheel(uint64_t start_tick = 0) : current(start_tick) {}
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  Handle schedule(T item, uint64_t expiry) {
+    pending.push_back({item, expiry, PENDING, 0});
+    Handle timer = std::prev(pending.end());
+    place(timer);
+    count++;
+    return timer;
+  }
+
+  void reschedule(Handle timer, uint64_t expiry) {
+    timer->expiry = expiry;
+    place(timer);
+  }
+
+  void cancel(Handle timer) {
+    list_for(*timer).erase(timer);
+    count--;
+  }
+
+  // Fires every timer due at or before `now`, calling expire(item) after
+  // the timer is removed, until `budget` timers have been fired or moved.
+  // Returns true once caught up with `now`, false if work remains.
+  template <typename Fn>
+  bool advance(uint64_t now, size_t budget, Fn &&expire) {
+    size_t work = 0;
+    while (true) {
+      TimerList *next = nullptr;
+      if (!pending.empty()) {
+        next = &pending;
+      } else if (due_count > 0) {
+        if (due[due_count - 1]->empty()) {
+          due_count--;
+          continue;
+        }
+        next = due[due_count - 1];
+      } else if (overflow_due > 0 && !overflow.empty()) {
+        overflow_due--;
+        next = &overflow;
+      }
+
+      if (next) {
+        if (work++ >= budget) {
+          return false;
+        }
+        fire_or_place(next->begin(), expire);
+        continue;
+      }
+      if (current >= now) {
+        return true;
+      }
+
+      current++;
+      for (int level = 0; level < LEVELS; level++) {
+        int shift = LEVEL_BITS * level;
+        if ((current & ((uint64_t(1) << shift) - 1)) != 0) {
+          break;
+        }
+        TimerList &slot = slots[level][(current >> shift) & (SLOTS - 1)];
+        if (!slot.empty()) {
+          due[due_count++] = &slot;
+        }
+      }
+      if ((current & ((uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1)) == 0) {
+        overflow_due = overflow.size();
+      }
+    }
+  }
+
+  size_t size() const { return count; }
+
+  uint64_t now() const { return current; }
+
+  void clear() {
+    for (auto &level : slots) {
+      for (auto &slot : level) {
+        slot.clear();
+      }
+    }
+    pending.clear();
+    overflow.clear();
+    count = 0;
+    due_count = overflow_due = 0;
+  }
+};
+
+#endif
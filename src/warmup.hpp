@@ -0,0 +1,141 @@
+#ifndef WARMUP_HPP
+#define WARMUP_HPP
+
+#include "cache.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct WarmupConfig {
+  // Preload the cache from PostgreSQL when the server starts.
+  bool enabled = false;
+  // Partitions read in parallel, each on its own pooled connection. At
+  // least one pool connection is always left for requests.
+  size_t workers = 4;
+  // Rows to preload; 0 means the cache's entry capacity, or no limit
+  // beyond the byte budget if that is unset too.
+  size_t max_entries = 0;
+  // Rows per FETCH, and per batch handed to the cache.
+  size_t batch_rows = 1000;
+
+  static WarmupConfig from_env() {
+    WarmupConfig config;
+    if (const char *enabled = std::getenv("CACHE_WARMUP")) {
+      config.enabled = strcmp(enabled, "1") == 0 ||
+                       strcmp(enabled, "true") == 0 ||
+                       strcmp(enabled, "on") == 0;
+    }
+    if (const char *workers = std::getenv("CACHE_WARMUP_WORKERS")) {
+      config.workers = std::max(1L, std::strtol(workers, nullptr, 10));
+    }
+    if (const char *max = std::getenv("CACHE_WARMUP_MAX")) {
+      config.max_entries = std::strtoul(max, nullptr, 10);
+    }
+    if (const char *batch = std::getenv("CACHE_WARMUP_BATCH")) {
+      config.batch_rows = std::max(1L, std::strtol(batch, nullptr, 10));
+    }
+    return config;
+  }
+};
+
+// Fills a freshly started cache with the most recently created live rows
+// from cache_entries, each keeping the TTL its expiry column has left.
+// Workers scan disjoint hash partitions of the keys in parallel while the
+// server already takes traffic; entries written or removed by requests in
+// the meantime win over the rows read (see LRUCache::warm_many()). Stops
+// early once the cache is full, and when destroyed.
+class CacheWarmer {
+public:
+  using Cache = LRUCache<std::string, std::string>;
+
+private:
+  Cache &cache;
+  DatabaseConnection *db;
+  CacheMetrics *metrics;
+  WarmupConfig config;
+  size_t partitions;
+  size_t limit; // rows per partition; 0 for no limit
+  std::chrono::steady_clock::time_point started;
+  std::atomic<bool> cancelled{false};
+  std::atomic<size_t> running{0};
+  std::atomic<size_t> loaded{0};
+  std::vector<std::thread> workers;
+
+  void run(size_t partition) {
+    // The server takes traffic while PostgreSQL is still connecting.
+    while (!cancelled && !db->wait_ready(std::chrono::milliseconds(100))) {
+    }
+    std::vector<Cache::Entry> entries;
+    entries.reserve(config.batch_rows);
+    try {
+      db->scan_recent(
+          partition, partitions, limit, config.batch_rows,
+          [&](const pqxx::result &rows) {
+            entries.clear();
+            for (const auto &row : rows) {
+              entries.push_back(
+                  {row[0].as<std::string>(), row[1].as<std::string>(),
+                   std::chrono::seconds(
+                       std::max<int64_t>(1, row[2].as<int64_t>()))});
+            }
+            size_t stored = cache.warm_many(entries);
+            loaded += stored;
+            metrics->observe_warmup_batch(stored, rows.size() - stored);
+            return !cancelled && !cache.full();
+          });
+    } catch (const std::exception &e) {
+      // Whatever was not preloaded is still read through on demand.
+      std::cerr << "Cache warm-up of partition " << partition
+                << " failed: " << e.what() << std::endl;
+    }
+    if (--running == 0) {
+      double seconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - started)
+                           .count();
+      metrics->record_warmup_finished(seconds);
+      std::cout << "Cache warm-up loaded " << loaded << " entries in "
+                << seconds << "s" << std::endl;
+    }
+  }
+
+public:
+  // `capacity` is the cache's entry limit (0 if unbounded), the default
+  // for config.max_entries. The pool must hold at least 2 connections, so
+  // one stays free for requests.
+  CacheWarmer(Cache &cache, const WarmupConfig &config, size_t capacity)
+      : cache(cache), db(cache.get_db()), metrics(cache.get_metrics()),
+        config(config), started(std::chrono::steady_clock::now()) {
+    size_t spare = db->max_connections() > 1 ? db->max_connections() - 1 : 1;
+    partitions = std::max<size_t>(1, std::min(config.workers, spare));
+    size_t total = config.max_entries > 0 ? config.max_entries : capacity;
+    limit = total == 0 ? 0 : (total + partitions - 1) / partitions;
+
+    metrics->record_warmup_started();
+    running = partitions;
+    for (size_t i = 0; i < partitions; i++) {
+      workers.emplace_back([this, i]() { run(i); });
+    }
+  }
+
+  ~CacheWarmer() {
+    cancelled = true;
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  CacheWarmer(const CacheWarmer &) = delete;
+  CacheWarmer &operator=(const CacheWarmer &) = delete;
+
+  bool done() const { return running == 0; }
+
+  // Entries stored so far.
+  size_t entries_loaded() const { return loaded; }
+};
+
+#endif
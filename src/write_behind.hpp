@@ -0,0 +1,358 @@
+#ifndef WRITE_BEHIND_HPP
+#define WRITE_BEHIND_HPP
+
+#include "metrics.hpp"
+#include "storage.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class WriteMode {
+  // Every write is its own transaction before put() returns.
+  SYNC,
+  // put() returns once its write is committed, but writes that arrive while
+  // a flush is running share the next transaction.
+  GROUP,
+  // put() returns immediately; writes are flushed when a batch fills or
+  // flush_interval passes, so a crash loses at most that window.
+  ASYNC,
+};
+
+struct WriteBehindConfig {
+  WriteMode mode = WriteMode::GROUP;
+  // Rows per upsert statement, and the batch size that triggers an ASYNC
+  // flush before flush_interval.
+  size_t batch_size = 512;
+  // Longest an ASYNC write waits before it is flushed.
+  std::chrono::milliseconds flush_interval = std::chrono::milliseconds(50);
+  // Distinct keys waiting to be flushed before writers block, or while the
+  // storage is unavailable, before further writes are dropped.
+  size_t max_pending = 100000;
+
+  static WriteBehindConfig from_env() {
+    WriteBehindConfig config;
+    if (const char *mode = std::getenv("CACHE_WRITE_MODE")) {
+      if (strcmp(mode, "sync") == 0)
+        config.mode = WriteMode::SYNC;
+      else if (strcmp(mode, "async") == 0)
+        config.mode = WriteMode::ASYNC;
+      else
+        config.mode = WriteMode::GROUP;
+    }
+    if (const char *batch = std::getenv("CACHE_WRITE_BATCH")) {
+      config.batch_size = std::max(1L, std::strtol(batch, nullptr, 10));
+    }
+    if (const char *interval = std::getenv("CACHE_WRITE_FLUSH_MS")) {
+      config.flush_interval = std::chrono::milliseconds(
+          std::max(1L, std::strtol(interval, nullptr, 10)));
+    }
+    if (const char *max = std::getenv("CACHE_WRITE_QUEUE_MAX")) {
+      config.max_pending = std::max(1L, std::strtol(max, nullptr, 10));
+    }
+    return config;
+  }
+};
+
+// Coalesces cache writes per key and hands them to `sink` in batches from
+// a single flusher thread, instead of one thread and one transaction per
+// write. A failed batch is requeued unless a newer write to the same key
+// has arrived, and retried after flush_interval.
+//
+// While the storage is not ready, or the last batch failed, writers never
+// wait: GROUP writes return at once as ASYNC ones do, and a write that
+// finds max_pending keys queued is dropped instead of blocking. The
+// flusher holds the queue until the storage is ready.
+class WriteBehindQueue {
+public:
+  using Sink = std::function<bool(const std::vector<CacheRow> &)>;
+  using Ready = std::function<bool()>;
+
+private:
+  WriteBehindConfig config;
+  Sink sink;
+  Ready storage_ready; // null if always ready
+  CacheMetrics &metrics;
+
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable batch_done;
+  std::unordered_map<std::string, CacheRow> pending;
+  // Keys upserted by the batch the flusher is writing.
+  std::unordered_set<std::string> in_flight;
+  std::chrono::steady_clock::time_point oldest_pending;
+  // Writes join batch `open_batch`; `done_batch` is the last one attempted.
+  uint64_t open_batch = 1;
+  uint64_t done_batch = 0;
+  bool flush_requested = false;
+  bool last_failed = false;
+  bool running = true;
+  std::thread flusher;
+
+  bool connected() const { return !storage_ready || storage_ready(); }
+
+  // Whether queued writes can be expected to reach the database soon, so
+  // writers may wait for them.
+  bool available() const { return !last_failed && connected(); }
+
+  bool ready_to_flush(std::chrono::steady_clock::time_point now) const {
+    return config.mode != WriteMode::ASYNC || !running || flush_requested ||
+           pending.size() >= config.batch_size ||
+           now >= oldest_pending + config.flush_interval;
+  }
+
+  void run() {
+    std::vector<CacheRow> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      if (pending.empty()) {
+        flush_requested = false;
+        if (!running)
+          break;
+        work_ready.wait(lock);
+        continue;
+      }
+      auto now = std::chrono::steady_clock::now();
+      if (!ready_to_flush(now)) {
+        work_ready.wait_until(lock, oldest_pending + config.flush_interval);
+        continue;
+      }
+      if (running && !connected()) {
+        batch_done.notify_all(); // writers blocked on max_pending shed
+        work_ready.wait_for(lock, config.flush_interval);
+        continue;
+      }
+
+      batch.clear();
+      batch.reserve(pending.size());
+      for (auto &entry : pending) {
+        if (!entry.second.deleted) {
+          in_flight.insert(entry.first);
+        }
+        batch.push_back(std::move(entry.second));
+      }
+      pending.clear();
+      uint64_t taken = open_batch++;
+      metrics.update_write_queue_depth(0);
+      batch_done.notify_all(); // writers blocked on max_pending
+
+      lock.unlock();
+      auto start = std::chrono::steady_clock::now();
+      bool ok = sink(batch);
+      metrics.observe_write_flush(
+          std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        start)
+              .count(),
+          batch.size(), ok);
+      lock.lock();
+      in_flight.clear();
+      last_failed = !ok;
+
+      if (!ok && running) {
+        size_t dropped = 0;
+        for (auto &row : batch) {
+          if (pending.count(row.key) != 0) {
+            continue; // superseded meanwhile
+          }
+          if (pending.size() >= config.max_pending) {
+            dropped++;
+            continue;
+          }
+          std::string key = row.key;
+          pending.emplace(std::move(key), std::move(row));
+        }
+        if (dropped > 0) {
+          metrics.record_write_dropped(dropped);
+        }
+        oldest_pending = std::chrono::steady_clock::now();
+        metrics.update_write_queue_depth(pending.size());
+      }
+      done_batch = taken;
+      batch_done.notify_all();
+      if (!ok && running) {
+        work_ready.wait_for(lock, config.flush_interval);
+      }
+    }
+  }
+
+  bool write_now(const std::vector<CacheRow> &rows) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = sink(rows);
+    metrics.observe_write_flush(
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+            .count(),
+        rows.size(), ok);
+    return ok;
+  }
+
+  // False if the row was dropped.
+  bool enqueue(std::unique_lock<std::mutex> &lock, const CacheRow &row) {
+    batch_done.wait(lock, [&]() {
+      return pending.size() < config.max_pending || !running ||
+             !available() || pending.count(row.key) != 0;
+    });
+    if (pending.size() >= config.max_pending && pending.count(row.key) == 0) {
+      metrics.record_write_dropped();
+      return false;
+    }
+    if (pending.empty()) {
+      oldest_pending = std::chrono::steady_clock::now();
+    }
+    auto [it, inserted] = pending.try_emplace(row.key);
+    if (!inserted) {
+      metrics.record_write_coalesced();
+    }
+    it->second = row;
+    metrics.update_write_queue_depth(pending.size());
+    return true;
+  }
+
+  // Wakes the flusher if the queued writes are due, and in GROUP mode
+  // waits for the batch holding them while the storage is available.
+  void submit(std::unique_lock<std::mutex> &lock) {
+    uint64_t batch = open_batch;
+    if (config.mode == WriteMode::GROUP ||
+        pending.size() >= config.batch_size) {
+      work_ready.notify_one();
+    }
+    if (config.mode == WriteMode::GROUP && available()) {
+      batch_done.wait(lock,
+                      [&]() { return done_batch >= batch || !running; });
+    }
+  }
+
+public:
+  WriteBehindQueue(const WriteBehindConfig &config, Sink sink,
+                   CacheMetrics &metrics, Ready storage_ready = nullptr)
+      : config(config), sink(std::move(sink)),
+        storage_ready(std::move(storage_ready)), metrics(metrics) {
+    if (config.mode != WriteMode::SYNC) {
+      flusher = std::thread([this]() { run(); });
+    }
+  }
+
+  // Flushes whatever is still queued before returning.
+  ~WriteBehindQueue() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    work_ready.notify_all();
+    batch_done.notify_all();
+    if (flusher.joinable()) {
+      flusher.join();
+    }
+  }
+
+  WriteBehindQueue(const WriteBehindQueue &) = delete;
+  WriteBehindQueue &operator=(const WriteBehindQueue &) = delete;
+
+  // Queues a write, replacing any queued write to the same key. Blocks
+  // while max_pending keys are queued, and in GROUP mode until the batch
+  // holding this write has been written; neither while the storage is
+  // unavailable. Returns false if the write is lost: it failed in SYNC
+  // mode, or was dropped because the queue was full.
+  bool write(const std::string &key, const std::string &value,
+             std::chrono::system_clock::time_point expiry) {
+    if (config.mode == WriteMode::SYNC) {
+      return write_now({{key, value, expiry}});
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    bool queued = enqueue(lock, {key, value, expiry});
+    submit(lock);
+    return queued;
+  }
+
+  // Queues removal of `key`, replacing any queued write to it. Returns
+  // false as write() does.
+  bool erase(const std::string &key) {
+    CacheRow row{key, std::string(), std::chrono::system_clock::time_point()};
+    row.deleted = true;
+    if (config.mode == WriteMode::SYNC) {
+      return write_now({row});
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    bool queued = enqueue(lock, row);
+    submit(lock);
+    return queued;
+  }
+
+  // write() for several rows at once: in GROUP mode they share one wait,
+  // and in SYNC mode one transaction. Keys must be unique. Returns false
+  // if any row is lost.
+  bool write_many(const std::vector<CacheRow> &rows) {
+    if (rows.empty()) {
+      return true;
+    }
+    if (config.mode == WriteMode::SYNC) {
+      return write_now(rows);
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    bool queued = true;
+    for (const auto &row : rows) {
+      queued = enqueue(lock, row) && queued;
+    }
+    submit(lock);
+    return queued;
+  }
+
+  // Blocks until every write queued so far has been attempted; returns at
+  // once while the storage is not ready.
+  void flush() {
+    if (config.mode == WriteMode::SYNC) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!connected()) {
+      return;
+    }
+    // With nothing queued, only a batch already being written can be owed.
+    uint64_t batch = pending.empty() ? open_batch - 1 : open_batch;
+    if (!pending.empty()) {
+      flush_requested = true;
+    }
+    work_ready.notify_one();
+    batch_done.wait(lock, [&]() { return done_batch >= batch || !running; });
+  }
+
+  // Batches attempted so far, to pass to settled() after a read.
+  uint64_t flushes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return done_batch;
+  }
+
+  // Whether a storage read that began when flushes() returned `since` saw
+  // every acknowledged write to `key`: none is queued or being written,
+  // and no batch finished meanwhile that the read may have missed. Only
+  // then may a miss be remembered as absent.
+  bool settled(const std::string &key, uint64_t since) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (done_batch != since || in_flight.count(key) != 0) {
+      return false;
+    }
+    auto it = pending.find(key);
+    return it == pending.end() || it->second.deleted;
+  }
+
+  // Whether an upsert of `key` is queued or being written.
+  bool holds(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = pending.find(key);
+    return it != pending.end() ? !it->second.deleted
+                               : in_flight.count(key) != 0;
+  }
+
+  size_t depth() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+  }
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "../src/cache.hpp"
+#include <atomic>
 #include <future>
 #include <gtest/gtest.h>
 #include <thread>
@@ -10,6 +11,9 @@ protected:
   void SetUp() override {
     cache = std::make_unique<LRUCache<std::string, std::string>>(
         3, std::chrono::seconds(5));
+    if (auto *db = cache->get_db()) {
+      db->wait_ready(std::chrono::seconds(5)); // connects in the background
+    }
   }
 
   void TearDown() override { cache.reset(); }
@@ -71,6 +75,496 @@ TEST_F(LRUCacheTest, CacheClear) {
   EXPECT_EQ(cache->size(), 0);
 }
 
+TEST_F(LRUCacheTest, ShardedCacheTracksPerShardHits) {
+  // Only one metrics exposer can bind its port at a time.
+  cache.reset();
+  LRUCache<std::string, std::string> sharded(1024, std::chrono::seconds(5),
+                                             16);
+  EXPECT_EQ(sharded.shard_count(), 16u);
+
+  for (int i = 0; i < 200; i++) {
+    sharded.put("key" + std::to_string(i), "value" + std::to_string(i));
+  }
+  std::string result;
+  for (int i = 0; i < 200; i++) {
+    EXPECT_TRUE(sharded.get("key" + std::to_string(i), result));
+  }
+  EXPECT_EQ(sharded.size(), 200u);
+
+  uint64_t hits = 0;
+  size_t capacity = 0, used_shards = 0;
+  for (const auto &stats : sharded.shard_stats()) {
+    hits += stats.hits;
+    capacity += stats.capacity;
+    used_shards += stats.size > 0;
+    EXPECT_LE(stats.size, stats.capacity);
+  }
+  EXPECT_EQ(hits, 200u);
+  EXPECT_EQ(capacity, 1024u);
+  EXPECT_GT(used_shards, 1u);
+}
+
+TEST_F(LRUCacheTest, SmallCachesStayUnsharded) {
+  EXPECT_EQ(cache->shard_count(), 1u);
+}
+
+TEST_F(LRUCacheTest, ExpiredEntriesAreRemovedWithoutReads) {
+  cache->load("short", "value", std::chrono::seconds(1));
+  cache->load("long", "value", std::chrono::seconds(60));
+  EXPECT_EQ(cache->expire(), 0u);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1300));
+  // The cleanup thread expires the entry on its own; expire() is a no-op
+  // unless it has not run yet.
+  cache->expire();
+  EXPECT_EQ(cache->size(), 1u);
+  std::string result;
+  EXPECT_TRUE(cache->lookup("long", result));
+}
+
+TEST_F(LRUCacheTest, ByteBudgetEvictsByMemory) {
+  cache.reset();
+  using Cache = LRUCache<std::string, std::string>;
+  Cache bounded(0, std::chrono::seconds(5), Cache::DEFAULT_SHARDS, 64 * 1024);
+  ASSERT_EQ(bounded.shard_count(), 1u);
+
+  std::string big(10 * 1024, 'x');
+  for (int i = 0; i < 10; i++) {
+    bounded.load("key" + std::to_string(i), big);
+  }
+  size_t entry_bytes = Cache::ENTRY_OVERHEAD + 4 + big.size();
+  EXPECT_EQ(bounded.size(), 64 * 1024 / entry_bytes);
+  EXPECT_EQ(bounded.memory_usage(), bounded.size() * entry_bytes);
+  EXPECT_LE(bounded.memory_usage(), bounded.max_memory());
+
+  std::string result;
+  EXPECT_FALSE(bounded.get("key0", result));
+  EXPECT_TRUE(bounded.get("key9", result));
+
+  // Shrinking a value releases its bytes.
+  size_t before = bounded.memory_usage();
+  bounded.load("key9", "small");
+  EXPECT_EQ(bounded.memory_usage(), before - big.size() + 5);
+
+  // A value larger than the whole budget is not held in memory.
+  bounded.load("huge", std::string(128 * 1024, 'y'));
+  EXPECT_FALSE(bounded.get("huge", result));
+  EXPECT_LE(bounded.memory_usage(), bounded.max_memory());
+
+  bounded.clear();
+  EXPECT_EQ(bounded.memory_usage(), 0u);
+}
+
+TEST_F(LRUCacheTest, TinyLfuKeepsHotSetThroughScan) {
+  cache.reset();
+  LRUCache<std::string, std::string, std::hash<std::string>,
+           TinyLfuPolicy<std::string>>
+      tinylfu(100, std::chrono::seconds(5));
+
+  std::string result;
+  for (int round = 0; round < 5; round++) {
+    for (int i = 0; i < 50; i++) {
+      std::string key = "hot" + std::to_string(i);
+      if (!tinylfu.lookup(key, result)) {
+        tinylfu.load(key, "value");
+      }
+    }
+  }
+  for (int i = 0; i < 1000; i++) {
+    tinylfu.load("scan" + std::to_string(i), "value");
+  }
+
+  int survivors = 0;
+  for (int i = 0; i < 50; i++) {
+    survivors += tinylfu.lookup("hot" + std::to_string(i), result);
+  }
+  EXPECT_EQ(survivors, 50);
+  EXPECT_LE(tinylfu.size(), 100u);
+}
+
+TEST(NegativeCacheTest, ForgetsKeysOnWriteExpiryAndOverflow) {
+  NegativeCache<std::string> absent(2, std::chrono::milliseconds(100));
+  auto now = std::chrono::steady_clock::now();
+
+  absent.insert("a", now);
+  absent.insert("b", now);
+  EXPECT_TRUE(absent.contains("a", now));
+  absent.erase("a");
+  EXPECT_FALSE(absent.contains("a", now));
+
+  absent.insert("c", now);
+  absent.insert("d", now); // evicts "b", the oldest
+  EXPECT_FALSE(absent.contains("b", now));
+  EXPECT_TRUE(absent.contains("c", now));
+  EXPECT_FALSE(absent.contains("d", now + std::chrono::milliseconds(100)));
+  EXPECT_EQ(absent.size(), 1u);
+}
+
+TEST_F(LRUCacheTest, PutClearsNegativeEntry) {
+  std::string result;
+  EXPECT_FALSE(cache->get("later", result)); // remembered as absent
+  cache->put("later", "value");
+  EXPECT_TRUE(cache->get("later", result));
+  EXPECT_EQ(result, "value");
+}
+
+TEST_F(LRUCacheTest, WarmUpKeepsNewerEntriesAndNeverEvicts) {
+  std::string result;
+  cache->put("written", "new");
+  EXPECT_FALSE(cache->get("removed", result)); // remembered as absent
+
+  // Rows as the warm-up reads them from the database.
+  std::vector<LRUCache<std::string, std::string>::Entry> rows;
+  for (const char *key : {"written", "removed", "a", "b", "c"}) {
+    rows.push_back({key, "old", std::chrono::seconds(60)});
+  }
+  size_t stored = cache->warm_many(rows);
+  EXPECT_EQ(stored, 2u); // a and b fill the cache; c finds no room
+  EXPECT_TRUE(cache->full());
+  EXPECT_TRUE(cache->lookup("written", result));
+  EXPECT_EQ(result, "new");
+  EXPECT_FALSE(cache->lookup("removed", result));
+  EXPECT_FALSE(cache->lookup("c", result));
+  auto ttl = cache->remaining_ttl("a");
+  ASSERT_TRUE(ttl.has_value());
+  EXPECT_GT(*ttl, std::chrono::seconds(50)); // the row's TTL, not the default
+}
+
+// Has one row, "stored", and reports ready only once `up` is set.
+class GatedStorage : public NullStorage {
+public:
+  std::atomic<bool> up{false};
+  std::atomic<int> lookups{0};
+
+  std::optional<std::string>
+  get(const std::string &key, std::chrono::seconds *remaining_ttl = nullptr,
+      bool * = nullptr) override {
+    lookups++;
+    if (remaining_ttl) {
+      *remaining_ttl = std::chrono::seconds(60);
+    }
+    return key == "stored" ? std::optional<std::string>("value")
+                           : std::nullopt;
+  }
+
+  bool ready() const override { return up; }
+};
+
+TEST(StorageTest, UnreadyStorageIsNotQueried) {
+  auto storage = std::make_unique<GatedStorage>();
+  GatedStorage *gated = storage.get();
+  LRUCache<std::string, std::string> cache(3, std::chrono::seconds(5), 1, 0,
+                                           std::move(storage));
+  std::string result;
+  EXPECT_FALSE(cache.get("stored", result));
+  EXPECT_FALSE(cache.get_many({"stored"})[0].has_value());
+  EXPECT_EQ(gated->lookups, 0);
+
+  // The misses were not remembered as absent, so the row is found now.
+  gated->up = true;
+  EXPECT_TRUE(cache.get("stored", result));
+  EXPECT_EQ(result, "value");
+  EXPECT_EQ(gated->lookups, 1);
+}
+
+TEST(StorageTest, RefreshesAheadAndServesStale) {
+  setenv("CACHE_REFRESH_AHEAD", "0.5", 1);
+  setenv("CACHE_SERVE_STALE_SECS", "5", 1);
+  auto storage = std::make_unique<GatedStorage>();
+  GatedStorage *gated = storage.get();
+  gated->up = true;
+  LRUCache<std::string, std::string> cache(3, std::chrono::seconds(5), 1, 0,
+                                           std::move(storage));
+  unsetenv("CACHE_REFRESH_AHEAD");
+  unsetenv("CACHE_SERVE_STALE_SECS");
+  auto wait_for_lookups = [&](int n) {
+    for (int i = 0; i < 200 && gated->lookups < n; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return gated->lookups == n;
+  };
+  std::string result;
+  bool stale;
+
+  // Read in the last half of its TTL: served, then reloaded behind it.
+  cache.put("stored", "old", std::chrono::seconds(2));
+  std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+  EXPECT_TRUE(cache.get("stored", result, &stale));
+  EXPECT_EQ(result, "old");
+  EXPECT_FALSE(stale);
+  ASSERT_TRUE(wait_for_lookups(1));
+  EXPECT_TRUE(cache.get("stored", result));
+  EXPECT_EQ(result, "value");
+
+  // Read after expiry: served marked stale while it reloads.
+  cache.put("stored", "old", std::chrono::seconds(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+  EXPECT_TRUE(cache.get("stored", result, &stale));
+  EXPECT_EQ(result, "old");
+  EXPECT_TRUE(stale);
+  ASSERT_TRUE(wait_for_lookups(2));
+  EXPECT_TRUE(cache.get("stored", result, &stale));
+  EXPECT_EQ(result, "value");
+  EXPECT_FALSE(stale);
+}
+
+TEST(StorageTest, PureCacheModeServesFromMemory) {
+  LRUCache<std::string, std::string> cache(3, std::chrono::seconds(5), 1, 0,
+                                           std::make_unique<NullStorage>());
+  std::string result;
+  cache.put("key", "value");
+  cache.flush();
+  EXPECT_TRUE(cache.get("key", result));
+  EXPECT_EQ(result, "value");
+  EXPECT_TRUE(cache.remove("key"));
+  EXPECT_FALSE(cache.get("key", result));
+  EXPECT_EQ(cache.get_db(), nullptr);
+}
+
+// Rows kept in memory, as PostgreSQL would keep them. The next `failures`
+// lookups fail, as during an outage.
+class MemoryStorage : public NullStorage {
+private:
+  std::mutex mutex;
+  std::unordered_map<std::string, std::string> rows;
+
+  bool fail(bool *failed) {
+    if (failures == 0) {
+      return false;
+    }
+    failures--;
+    if (failed) {
+      *failed = true;
+    }
+    return true;
+  }
+
+public:
+  std::atomic<int> failures{0};
+
+  bool put_many(const std::vector<CacheRow> &batch) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &row : batch) {
+      if (row.deleted) {
+        rows.erase(row.key);
+      } else {
+        rows[row.key] = row.value;
+      }
+    }
+    return true;
+  }
+
+  bool put(const std::string &key, const std::string &value,
+           const std::chrono::system_clock::time_point &expiry) override {
+    return put_many({{key, value, expiry}});
+  }
+
+  std::optional<std::string>
+  get(const std::string &key, std::chrono::seconds *remaining_ttl = nullptr,
+      bool *failed = nullptr) override {
+    if (fail(failed)) {
+      return std::nullopt;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = rows.find(key);
+    if (it == rows.end()) {
+      return std::nullopt;
+    }
+    if (remaining_ttl) {
+      *remaining_ttl = std::chrono::seconds(60);
+    }
+    return it->second;
+  }
+
+  std::vector<CacheRow> get_many(const std::vector<std::string> &keys,
+                                 bool *failed = nullptr) override {
+    if (fail(failed)) {
+      return {};
+    }
+    std::vector<CacheRow> found;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &key : keys) {
+      auto it = rows.find(key);
+      if (it != rows.end()) {
+        found.push_back({key, it->second,
+                         std::chrono::system_clock::now() +
+                             std::chrono::seconds(60)});
+      }
+    }
+    return found;
+  }
+
+  bool persistent() const override { return true; }
+};
+
+TEST(StorageTest, EvictedUnflushedWriteIsNotRememberedAbsent) {
+  setenv("CACHE_WRITE_MODE", "async", 1);
+  setenv("CACHE_WRITE_FLUSH_MS", "60000", 1);
+  LRUCache<std::string, std::string> cache(1, std::chrono::seconds(60), 1, 0,
+                                           std::make_unique<MemoryStorage>());
+  unsetenv("CACHE_WRITE_MODE");
+  unsetenv("CACHE_WRITE_FLUSH_MS");
+
+  cache.put("a", "1");
+  cache.put("b", "2"); // evicts a before its write is flushed
+  std::string result;
+  EXPECT_FALSE(cache.get("a", result)); // not in the database yet
+  cache.flush();
+  EXPECT_TRUE(cache.get("a", result));
+  EXPECT_EQ(result, "1");
+
+  cache.put("c", "3");
+  cache.put("d", "4"); // evicts c, again unflushed
+  EXPECT_TRUE(cache.remove("c"));
+}
+
+TEST(StorageTest, FailedLookupIsNotRememberedAbsent) {
+  auto storage = std::make_unique<MemoryStorage>();
+  MemoryStorage *memory = storage.get();
+  memory->put("a", "1", std::chrono::system_clock::now());
+  LRUCache<std::string, std::string> cache(3, std::chrono::seconds(60), 1, 0,
+                                           std::move(storage));
+
+  memory->failures = 2;
+  std::string result;
+  EXPECT_FALSE(cache.get("a", result));
+  EXPECT_FALSE(cache.get_many({"a"})[0].has_value());
+
+  // The database is back: the row is read, not a remembered miss.
+  EXPECT_TRUE(cache.get("a", result));
+  EXPECT_EQ(result, "1");
+}
+
+TEST(StorageTest, BatchGetReplacesStaleEntries) {
+  setenv("CACHE_SERVE_STALE_SECS", "5", 1);
+  auto storage = std::make_unique<MemoryStorage>();
+  MemoryStorage *memory = storage.get();
+  LRUCache<std::string, std::string> cache(3, std::chrono::seconds(60), 1, 0,
+                                           std::move(storage));
+  unsetenv("CACHE_SERVE_STALE_SECS");
+
+  cache.put("a", "old", std::chrono::seconds(1));
+  memory->put("a", "new", std::chrono::system_clock::now());
+  std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+  auto values = cache.get_many({"a"});
+  ASSERT_TRUE(values[0].has_value());
+  EXPECT_EQ(*values[0], "new");
+
+  // The row replaced the stale entry in memory.
+  std::string result;
+  EXPECT_TRUE(cache.lookup("a", result));
+  EXPECT_EQ(result, "new");
+}
+
+class WriteBehindTest : public ::testing::Test {
+protected:
+  CacheMetrics metrics;
+  std::mutex sink_mutex;
+  std::vector<std::vector<CacheRow>> batches;
+
+  WriteBehindQueue::Sink sink() {
+    return [this](const std::vector<CacheRow> &rows) {
+      std::lock_guard<std::mutex> lock(sink_mutex);
+      batches.push_back(rows);
+      return true;
+    };
+  }
+};
+
+TEST_F(WriteBehindTest, AsyncModeCoalescesAndBatches) {
+  WriteBehindConfig config;
+  config.mode = WriteMode::ASYNC;
+  config.flush_interval = std::chrono::seconds(10);
+  WriteBehindQueue queue(config, sink(), metrics);
+
+  auto expiry = std::chrono::system_clock::now() + std::chrono::seconds(60);
+  for (int i = 0; i < 100; i++) {
+    queue.write("key" + std::to_string(i % 10), "value" + std::to_string(i),
+                expiry);
+  }
+  EXPECT_EQ(queue.depth(), 10u);
+  queue.flush();
+
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  ASSERT_EQ(batches.size(), 1u);
+  ASSERT_EQ(batches[0].size(), 10u);
+  for (const auto &row : batches[0]) {
+    int index = std::stoi(row.key.substr(3));
+    EXPECT_EQ(row.value, "value" + std::to_string(90 + index));
+  }
+}
+
+TEST_F(WriteBehindTest, GroupModeWritesBeforeReturning) {
+  WriteBehindConfig config;
+  config.mode = WriteMode::GROUP;
+  WriteBehindQueue queue(config, sink(), metrics);
+
+  std::vector<std::thread> writers;
+  for (int i = 0; i < 8; i++) {
+    writers.emplace_back([&queue, i]() {
+      queue.write("key" + std::to_string(i), "value",
+                  std::chrono::system_clock::now());
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  size_t rows = 0;
+  for (const auto &batch : batches) {
+    rows += batch.size();
+  }
+  EXPECT_EQ(rows, 8u);
+  EXPECT_LE(batches.size(), 8u);
+}
+
+TEST_F(WriteBehindTest, WritersDoNotWaitWhileStorageIsDown) {
+  WriteBehindConfig config;
+  config.mode = WriteMode::GROUP;
+  config.max_pending = 2;
+  std::atomic<bool> up{false};
+  WriteBehindQueue queue(config, sink(), metrics, [&]() { return up.load(); });
+
+  auto expiry = std::chrono::system_clock::now() + std::chrono::seconds(60);
+  queue.write("key0", "value", expiry);
+  queue.write("key1", "value", expiry);
+  EXPECT_FALSE(queue.write("key2", "value", expiry)); // queue full: dropped
+  queue.write("key0", "newer", expiry); // coalesced, never dropped
+  EXPECT_EQ(queue.depth(), 2u);
+
+  up = true;
+  queue.flush();
+  std::lock_guard<std::mutex> lock(sink_mutex);
+  size_t rows = 0;
+  for (const auto &batch : batches) {
+    for (const auto &row : batch) {
+      EXPECT_NE(row.key, "key2");
+      if (row.key == "key0") {
+        EXPECT_EQ(row.value, "newer");
+      }
+    }
+    rows += batch.size();
+  }
+  EXPECT_EQ(rows, 2u);
+}
+
+TEST_F(WriteBehindTest, SyncModeReportsFailedWrites) {
+  WriteBehindConfig config;
+  config.mode = WriteMode::SYNC;
+  bool ok = false;
+  WriteBehindQueue queue(
+      config, [&](const std::vector<CacheRow> &) { return ok; }, metrics);
+
+  auto expiry = std::chrono::system_clock::now() + std::chrono::seconds(60);
+  EXPECT_FALSE(queue.write("key", "value", expiry));
+  EXPECT_FALSE(queue.write_many({{"key", "value", expiry}}));
+  EXPECT_FALSE(queue.erase("key"));
+  ok = true;
+  EXPECT_TRUE(queue.write("key", "value", expiry));
+  EXPECT_TRUE(queue.erase("key"));
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
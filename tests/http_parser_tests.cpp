@@ -0,0 +1,156 @@
+#include "../src/http_parser.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+class HttpParserTest : public ::testing::Test {
+protected:
+  HttpParser parser{8192, 1024};
+  HttpRequest request;
+
+  HttpParser::Status parse(std::string &buffer) {
+    return parser.parse(&buffer[0], buffer.size(), request);
+  }
+};
+
+TEST_F(HttpParserTest, ParsesRequestLineAndHeaders) {
+  std::string buffer = "GET /api/cached/user123?fresh=1 HTTP/1.1\r\n"
+                       "Host: localhost\r\n"
+                       "X-Trace:   abc  \r\n\r\n";
+  ASSERT_EQ(parse(buffer), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.method, "GET");
+  EXPECT_EQ(request.path, "/api/cached/user123");
+  EXPECT_EQ(request.query, "fresh=1");
+  EXPECT_EQ(request.version, "HTTP/1.1");
+  EXPECT_EQ(request.header("host"), "localhost");
+  EXPECT_EQ(request.header("X-TRACE"), "abc");
+  EXPECT_TRUE(request.body.empty());
+  EXPECT_TRUE(request.keep_alive);
+  EXPECT_EQ(parser.consumed(), buffer.size());
+}
+
+TEST_F(HttpParserTest, ResumesAcrossPartialReads) {
+  std::string full = "POST /api/cached HTTP/1.1\r\n"
+                     "Content-Length: 11\r\n\r\n"
+                     "hello world";
+  std::string buffer;
+  for (size_t i = 0; i + 1 < full.size(); i++) {
+    buffer += full[i];
+    ASSERT_EQ(parse(buffer), HttpParser::Status::INCOMPLETE) << i;
+  }
+  buffer += full.back();
+  ASSERT_EQ(parse(buffer), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.body, "hello world");
+}
+
+TEST_F(HttpParserTest, SurvivesBufferMovingMidRequest) {
+  std::string head = "POST /api/cached HTTP/1.1\r\nContent-Length: 5\r\n\r\n";
+  std::string first = head;
+  ASSERT_EQ(parse(first), HttpParser::Status::INCOMPLETE);
+
+  // The connection buffer grew and its bytes moved to new storage.
+  std::string moved = head + "hello";
+  first.assign(first.size(), 'x');
+  ASSERT_EQ(parse(moved), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.method, "POST");
+  EXPECT_EQ(request.path, "/api/cached");
+  EXPECT_EQ(request.header("Content-Length"), "5");
+  EXPECT_EQ(request.body, "hello");
+}
+
+TEST_F(HttpParserTest, BodyContainingRouteIsNotRouting) {
+  std::string buffer = "POST /api/echo HTTP/1.1\r\n"
+                       "Content-Length: 24\r\n\r\n"
+                       "GET /api/export HTTP/1.1";
+  ASSERT_EQ(parse(buffer), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.method, "POST");
+  EXPECT_EQ(request.path, "/api/echo");
+  EXPECT_EQ(request.body, "GET /api/export HTTP/1.1");
+}
+
+TEST_F(HttpParserTest, DecodesChunkedBody) {
+  std::string buffer = "POST /api/echo HTTP/1.1\r\n"
+                       "Transfer-Encoding: chunked\r\n\r\n"
+                       "5\r\nhello\r\n"
+                       "6;ext=1\r\n world\r\n"
+                       "0\r\n"
+                       "Trailer: x\r\n\r\n"
+                       "GET /next HTTP/1.1\r\n\r\n";
+  size_t first_length = buffer.find("GET /next");
+  ASSERT_EQ(parse(buffer), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.body, "hello world");
+  EXPECT_EQ(parser.consumed(), first_length);
+}
+
+TEST_F(HttpParserTest, ParsesPipelinedRequests) {
+  std::string buffer = "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.0\r\n\r\n";
+  ASSERT_EQ(parse(buffer), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.path, "/a");
+
+  size_t offset = parser.consumed();
+  parser.reset();
+  ASSERT_EQ(parser.parse(&buffer[offset], buffer.size() - offset, request),
+            HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.path, "/b");
+  EXPECT_FALSE(request.keep_alive);
+}
+
+TEST_F(HttpParserTest, HonorsConnectionHeader) {
+  std::string close = "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+  ASSERT_EQ(parse(close), HttpParser::Status::COMPLETE);
+  EXPECT_FALSE(request.keep_alive);
+
+  parser.reset();
+  std::string keep = "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n";
+  ASSERT_EQ(parse(keep), HttpParser::Status::COMPLETE);
+  EXPECT_TRUE(request.keep_alive);
+}
+
+TEST_F(HttpParserTest, RejectsMalformedRequests) {
+  std::string bad_line = "GARBAGE\r\n\r\n";
+  EXPECT_EQ(parse(bad_line), HttpParser::Status::ERROR);
+  EXPECT_EQ(parser.error_status(), 400);
+
+  parser.reset();
+  std::string too_large = "POST / HTTP/1.1\r\nContent-Length: 4096\r\n\r\n";
+  EXPECT_EQ(parse(too_large), HttpParser::Status::ERROR);
+  EXPECT_EQ(parser.error_status(), 413);
+
+  parser.reset();
+  std::string smuggled = "POST / HTTP/1.1\r\nContent-Length: 3\r\n"
+                         "Transfer-Encoding: chunked\r\n\r\n";
+  EXPECT_EQ(parse(smuggled), HttpParser::Status::ERROR);
+  EXPECT_EQ(parser.error_status(), 400);
+
+  parser.reset();
+  std::string bad_chunk = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                          "zz\r\n";
+  EXPECT_EQ(parse(bad_chunk), HttpParser::Status::ERROR);
+  EXPECT_EQ(parser.error_status(), 400);
+}
+
+TEST_F(HttpParserTest, ReportsHeadersBeforeBody) {
+  parser.set_report_headers(true);
+  std::string buffer = "POST /api/import HTTP/1.1\r\n"
+                       "Content-Length: 4096\r\n\r\n"
+                       "{\"key\":";
+  ASSERT_EQ(parse(buffer), HttpParser::Status::HEADERS);
+  EXPECT_EQ(request.path, "/api/import");
+  EXPECT_EQ(parser.body_length(), 4096u);
+  EXPECT_FALSE(parser.chunked_body());
+  EXPECT_EQ(buffer.substr(parser.header_bytes()), "{\"key\":");
+
+  // Continuing applies the body limit as usual.
+  EXPECT_EQ(parse(buffer), HttpParser::Status::ERROR);
+  EXPECT_EQ(parser.error_status(), 413);
+
+  parser.reset();
+  std::string small = "POST /api/echo HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}";
+  ASSERT_EQ(parse(small), HttpParser::Status::HEADERS);
+  ASSERT_EQ(parse(small), HttpParser::Status::COMPLETE);
+  EXPECT_EQ(request.body, "{}");
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
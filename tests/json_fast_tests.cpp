@@ -0,0 +1,65 @@
+#include "../src/json_fast.hpp"
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <string>
+
+using json = nlohmann::json;
+
+class JsonFastTest : public ::testing::Test {
+protected:
+  json_fast::Parser parser;
+  json_fast::CacheEntryRequest entry;
+  std::string scratch;
+
+  bool parse(const std::string &body) {
+    return parser.parse_entry(body, entry, scratch);
+  }
+};
+
+TEST_F(JsonFastTest, WritesSameBytesAsNlohmann) {
+  std::string value = "quote\" slash\\ tab\t nl\n ctl\x01\x1f caf\xc3\xa9 /";
+  json expected = {{"key", "user:1"}, {"value", value}, {"status", "success"}};
+
+  std::string out;
+  json_fast::append_object(
+      out, {{"key", "user:1"}, {"status", "success"}, {"value", value}});
+  EXPECT_EQ(out, expected.dump());
+  EXPECT_EQ(json_fast::object_size(
+                {{"key", "user:1"}, {"status", "success"}, {"value", value}}),
+            out.size());
+
+  out.clear();
+  json_fast::append_object(out, {{"key", "k"}, {"ttl", int64_t(-42)}});
+  EXPECT_EQ(out, json({{"key", "k"}, {"ttl", -42}}).dump());
+}
+
+TEST_F(JsonFastTest, ParsesEntryWithEscapes) {
+  ASSERT_TRUE(parse(" {\"value\": \"a\\\"b\\\\c\\n\\u00e9\\ud83d\\ude00\","
+                    " \"note\": null, \"key\":\"k\\/1\", \"ttl\": 60 } "));
+  EXPECT_EQ(entry.key, "k/1");
+  EXPECT_EQ(entry.value, "a\"b\\c\n\xc3\xa9\xf0\x9f\x98\x80");
+  EXPECT_EQ(entry.ttl, 60);
+
+  ASSERT_TRUE(parse("{\"key\":\"k\",\"value\":\"\"}"));
+  EXPECT_EQ(entry.value, "");
+  EXPECT_EQ(entry.ttl, 300); // default when absent
+}
+
+TEST_F(JsonFastTest, DeclinesWhatItDoesNotHandle) {
+  EXPECT_FALSE(parse(""));
+  EXPECT_FALSE(parse("{}"));
+  EXPECT_FALSE(parse("{\"key\":\"k\"}"));                            // no value
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":1}"));                // not string
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":\"v\",\"ttl\":1.5}")); // fraction
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":\"v\",\"x\":[1]}"));   // nested
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"key\":\"j\",\"value\":\"v\"}"));
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":\"v\"} x"));
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":\"\xc3\xa9\"}")); // raw UTF-8
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":\"\\ud83d\"}"));   // lone surrogate
+  EXPECT_FALSE(parse("{\"key\":\"k\",\"value\":\"v\""));
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,72 @@
+#include "../src/latency.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogramTest, CountsAcrossThreadsIntoCumulativeBuckets) {
+  LatencyHistogram histogram({0.001, 0.01});
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 1000; i++) {
+        histogram.observe(1ms); // le 0.001: bounds are inclusive
+        histogram.observe(5ms); // le 0.01
+        histogram.observe(1s);  // +Inf
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  auto collected = histogram.collect();
+  ASSERT_EQ(collected.bucket.size(), 3u);
+  EXPECT_EQ(collected.bucket[0].cumulative_count, 8000u);
+  EXPECT_EQ(collected.bucket[1].cumulative_count, 16000u);
+  EXPECT_EQ(collected.bucket[2].cumulative_count, 24000u);
+  EXPECT_TRUE(std::isinf(collected.bucket[2].upper_bound));
+  EXPECT_EQ(collected.sample_count, 24000u);
+  EXPECT_NEAR(collected.sample_sum, 8000 * 1.006, 1e-6);
+}
+
+TEST(LatencyHistogramTest, FamilyReusesSeriesPerLabelSet) {
+  LatencyFamily family("test_seconds", "Test", {0.1});
+  auto &ok = family.add({{"status", "200"}});
+  EXPECT_EQ(&family.add({{"status", "200"}}), &ok);
+  family.add({{"status", "404"}}).observe(1ms);
+  ok.observe(1ms);
+  ok.observe(1ms);
+
+  auto families = family.Collect();
+  ASSERT_EQ(families.size(), 1u);
+  EXPECT_EQ(families[0].type, prometheus::MetricType::Histogram);
+  ASSERT_EQ(families[0].metric.size(), 2u);
+  EXPECT_EQ(families[0].metric[0].label[0].value, "200");
+  EXPECT_EQ(families[0].metric[0].histogram.sample_count, 2u);
+  EXPECT_EQ(families[0].metric[1].histogram.sample_count, 1u);
+}
+
+TEST(TimedMutexTest, RecordsWaitsAndSampledHolds) {
+  LatencyHistogram wait({0.001}), hold({0.001});
+  TimedMutex mutex;
+  mutex.observe(&wait, &hold);
+  for (uint32_t i = 0; i < TimedMutex::HOLD_SAMPLE; i++) {
+    std::lock_guard<TimedMutex> lock(mutex);
+  }
+  EXPECT_EQ(wait.collect().sample_count, TimedMutex::HOLD_SAMPLE);
+  EXPECT_EQ(wait.collect().bucket[0].cumulative_count, TimedMutex::HOLD_SAMPLE);
+  EXPECT_EQ(hold.collect().sample_count, 1u);
+
+  mutex.lock();
+  std::thread waiter([&]() { std::lock_guard<TimedMutex> lock(mutex); });
+  std::this_thread::sleep_for(20ms);
+  mutex.unlock();
+  waiter.join();
+  // The blocked acquisition lands above the 1ms bound.
+  auto waits = wait.collect();
+  EXPECT_EQ(waits.sample_count, TimedMutex::HOLD_SAMPLE + 2);
+  EXPECT_EQ(waits.bucket[0].cumulative_count, TimedMutex::HOLD_SAMPLE + 1);
+  EXPECT_GE(waits.sample_sum, 0.015);
+}
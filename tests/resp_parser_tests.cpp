@@ -0,0 +1,85 @@
+#include "../src/resp.hpp"
+#include <gtest/gtest.h>
+#include <string>
+
+class RespParserTest : public ::testing::Test {
+protected:
+  RespParser parser{1024, 16};
+  RespCommand command;
+
+  RespParser::Status parse(const std::string &buffer) {
+    return parser.parse(buffer.data(), buffer.size(), command);
+  }
+};
+
+TEST_F(RespParserTest, ParsesBulkStringArray) {
+  std::string buffer = "*3\r\n$3\r\nSET\r\n$4\r\nuser\r\n$8\r\nJohn\r\nDo\r\n";
+  ASSERT_EQ(parse(buffer), RespParser::Status::COMPLETE);
+  ASSERT_EQ(command.args.size(), 3u);
+  EXPECT_TRUE(command.is("SET"));
+  EXPECT_EQ(command.args[1], "user");
+  EXPECT_EQ(command.args[2], "John\r\nDo"); // binary safe
+  EXPECT_EQ(parser.consumed(), buffer.size());
+}
+
+TEST_F(RespParserTest, ResumesAcrossPartialReads) {
+  std::string full = "*2\r\n$3\r\nget\r\n$5\r\nhello\r\n";
+  std::string buffer;
+  for (size_t i = 0; i + 1 < full.size(); i++) {
+    buffer += full[i];
+    ASSERT_EQ(parse(buffer), RespParser::Status::INCOMPLETE) << i;
+  }
+  buffer += full.back();
+  ASSERT_EQ(parse(buffer), RespParser::Status::COMPLETE);
+  EXPECT_TRUE(command.is("GET"));
+  EXPECT_EQ(command.args[1], "hello");
+}
+
+TEST_F(RespParserTest, ParsesInlineAndPipelinedCommands) {
+  std::string buffer = "PING\r\n*1\r\n$4\r\nPING\r\n";
+  ASSERT_EQ(parse(buffer), RespParser::Status::COMPLETE);
+  EXPECT_TRUE(command.is("PING"));
+  size_t offset = parser.consumed();
+  EXPECT_EQ(offset, 6u);
+
+  parser.reset();
+  ASSERT_EQ(parser.parse(buffer.data() + offset, buffer.size() - offset,
+                         command),
+            RespParser::Status::COMPLETE);
+  EXPECT_TRUE(command.is("PING"));
+}
+
+TEST_F(RespParserTest, RejectsMalformedCommands) {
+  EXPECT_EQ(parse("*1\r\n:3\r\n"), RespParser::Status::ERROR);
+
+  parser.reset();
+  EXPECT_EQ(parse("*1\r\n$2048\r\n"), RespParser::Status::ERROR);
+
+  parser.reset();
+  EXPECT_EQ(parse("*17\r\n"), RespParser::Status::ERROR);
+
+  parser.reset();
+  EXPECT_EQ(parse("*1\r\n$3\r\nGETX\r\n"), RespParser::Status::ERROR);
+  EXPECT_NE(parser.error_message(), nullptr);
+}
+
+TEST_F(RespParserTest, RejectsCommandsOverTheTotalLimit) {
+  // Each argument fits on its own, but together they pass 1024 bytes.
+  std::string buffer = "*3\r\n";
+  for (int i = 0; i < 3; i++) {
+    buffer += "$400\r\n" + std::string(400, 'x') + "\r\n";
+  }
+  EXPECT_EQ(parse(buffer), RespParser::Status::ERROR);
+  EXPECT_STREQ(parser.error_message(), "Protocol error: command too large");
+
+  // Rejected from the header alone, before the argument arrives.
+  parser.reset();
+  EXPECT_EQ(parse("*2\r\n$1000\r\n" + std::string(1000, 'x') +
+                  "\r\n$100\r\n"),
+            RespParser::Status::ERROR);
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
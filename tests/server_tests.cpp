@@ -15,6 +15,7 @@ protected:
   std::unique_ptr<std::thread> server_thread;
   std::shared_ptr<std::atomic<bool>> stop_signal;
   int port;
+  int resp_port;
 
   void SetUp() override {
     // Use random port between 10000-65535
@@ -28,8 +29,11 @@ protected:
 
     while (!server_started && retry_count < MAX_RETRIES) {
       try {
+        resp_port = port + 1;
         server_thread = std::make_unique<std::thread>([this]() {
-          HttpServer server(port, *stop_signal);
+          ServerConfig config = ServerConfig::from_env();
+          config.resp_port = resp_port;
+          HttpServer server(port, *stop_signal, config);
           server.start();
         });
 
@@ -218,6 +222,31 @@ TEST_F(ServerTest, TestCacheClear) {
   EXPECT_EQ(get_json["status"], "error");
 }
 
+TEST_F(ServerTest, TestCacheBatchSetAndGet) {
+  json entries = json::array();
+  for (int i = 0; i < 50; i++) {
+    entries.push_back({{"key", "batch_" + std::to_string(i)},
+                       {"value", "value_" + std::to_string(i)},
+                       {"ttl", 60}});
+  }
+  json set_json = json::parse(makeRequest(
+      "/api/cached/batch", "POST", json({{"entries", entries}}).dump()));
+  EXPECT_EQ(set_json["status"], "success");
+  EXPECT_EQ(set_json["count"], 50);
+
+  json keys = {"batch_0", "batch_49", "batch_missing"};
+  json get_json = json::parse(makeRequest("/api/cached/batch/get", "POST",
+                                          json({{"keys", keys}}).dump()));
+  EXPECT_EQ(get_json["status"], "success");
+  EXPECT_EQ(get_json["entries"]["batch_0"], "value_0");
+  EXPECT_EQ(get_json["entries"]["batch_49"], "value_49");
+  EXPECT_EQ(get_json["missing"], json::array({"batch_missing"}));
+
+  json bad_json = json::parse(
+      makeRequest("/api/cached/batch", "POST", R"({"entries": [{"key": 1}]})"));
+  EXPECT_EQ(bad_json["error"], "Invalid request");
+}
+
 TEST_F(ServerTest, TestInvalidJSON) {
   std::string invalid_json = "{invalid_json}";
   std::string response = makeRequest("/api/cached", "POST", invalid_json);
@@ -227,6 +256,157 @@ TEST_F(ServerTest, TestInvalidJSON) {
   EXPECT_EQ(response_json["error"], "Invalid JSON");
 }
 
+TEST_F(ServerTest, TestLargeValueRoundTrip) {
+  std::string large_value(256 * 1024, 'v');
+  json test_data = {{"key", "large_key"}, {"value", large_value}, {"ttl", 60}};
+  std::string add_response =
+      makeRequest("/api/cached", "POST", test_data.dump());
+  EXPECT_EQ(json::parse(add_response)["status"], "success");
+
+  json get_json = json::parse(makeRequest("/api/cached/large_key"));
+  EXPECT_EQ(get_json["status"], "success");
+  EXPECT_EQ(get_json["value"], large_value);
+}
+
+TEST_F(ServerTest, TestBodyDoesNotAffectRouting) {
+  json test_data = {{"text", "GET /api/export HTTP/1.1"}};
+  std::string response = makeRequest("/api/echo", "POST", test_data.dump());
+  json response_json = json::parse(response);
+
+  EXPECT_EQ(response_json["status"], "success");
+  EXPECT_EQ(response_json["echo"], test_data);
+}
+
+TEST_F(ServerTest, TestKeepAlivePipelining) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  struct sockaddr_in address {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+
+  // Three requests in one write; the last asks the server to close.
+  std::string requests = "GET /api/hello HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                         "GET /api/hello HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                         "GET /api/hello HTTP/1.1\r\nHost: localhost\r\n"
+                         "Connection: close\r\n\r\n";
+  ASSERT_EQ(send(fd, requests.data(), requests.size(), 0),
+            (ssize_t)requests.size());
+
+  std::string responses;
+  char buffer[1024];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    responses.append(buffer, n);
+  }
+  close(fd);
+
+  size_t count = 0;
+  for (size_t pos = responses.find("HTTP/1.1 200 OK"); pos != std::string::npos;
+       pos = responses.find("HTTP/1.1 200 OK", pos + 1)) {
+    count++;
+  }
+  EXPECT_EQ(count, 3u);
+  EXPECT_NE(responses.find("Content-Length: 46"), std::string::npos);
+  EXPECT_NE(responses.find("Connection: close"), std::string::npos);
+}
+
+TEST_F(ServerTest, TestExportStreams) {
+  json exported = json::parse(makeRequest("/api/export"));
+  ASSERT_TRUE(exported["entries"].is_array());
+  EXPECT_TRUE(exported["timestamp"].is_string());
+
+  std::string lines = makeRequest("/api/export?format=ndjson");
+  std::istringstream stream(lines);
+  for (std::string line; std::getline(stream, line);) {
+    EXPECT_TRUE(json::parse(line).contains("key"));
+  }
+
+  // The export is chunked and the pipelined request after it waits its turn.
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  struct sockaddr_in address {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+  std::string requests = "GET /api/export HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                         "GET /api/hello HTTP/1.1\r\nHost: localhost\r\n"
+                         "Connection: close\r\n\r\n";
+  ASSERT_EQ(send(fd, requests.data(), requests.size(), 0),
+            (ssize_t)requests.size());
+  std::string responses;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    responses.append(buffer, n);
+  }
+  close(fd);
+
+  size_t end_of_export = responses.find("\r\n0\r\n\r\n");
+  EXPECT_NE(responses.find("Transfer-Encoding: chunked"), std::string::npos);
+  ASSERT_NE(end_of_export, std::string::npos);
+  EXPECT_GT(responses.find("Hello, World!"), end_of_export);
+}
+
+TEST_F(ServerTest, TestImportNdjson) {
+  std::string body =
+      "{\"key\":\"import:1\",\"value\":\"one\","
+      "\"expiry\":\"2999-01-01 00:00:00\",\"created_at\":\"2024-10-27 02:01:25\"}\n"
+      "{\"key\":\"import:2\",\"value\":\"two\",\"expiry\":\"2000-01-01 00:00:00\"}\r\n"
+      "\n"
+      "not json\n"
+      "{\"key\":\"import:1\",\"value\":\"caf\u00e9\",\"expiry\":\"2999-01-01 00:00:00\"}";
+  json response = json::parse(makeRequest("/api/import", "POST", body));
+  EXPECT_EQ(response["status"], "success");
+  EXPECT_EQ(response["invalid"], 1);
+  // import:1 appears twice in one batch and counts once.
+  EXPECT_EQ(response["imported"].get<int>() + response["expired"].get<int>(),
+            2);
+}
+
+TEST_F(ServerTest, TestRespCommands) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  struct sockaddr_in address {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(resp_port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(connect(fd, (struct sockaddr *)&address, sizeof(address)), 0);
+
+  // Pipelined, with one inline command; QUIT makes the server close.
+  std::string commands =
+      "*5\r\n$3\r\nSET\r\n$5\r\nr_key\r\n$5\r\nvalue\r\n$2\r\nEX\r\n$"
+      "2\r\n60\r\n"
+      "*2\r\n$3\r\nGET\r\n$5\r\nr_key\r\n"
+      "*3\r\n$4\r\nMGET\r\n$5\r\nr_key\r\n$7\r\nr_other\r\n"
+      "TTL r_key\r\n"
+      "*2\r\n$3\r\nDEL\r\n$5\r\nr_key\r\n"
+      "*2\r\n$3\r\nGET\r\n$5\r\nr_key\r\n"
+      "SET r_key value EX 9999999999999\r\n"
+      "*1\r\n$4\r\nQUIT\r\n";
+  ASSERT_EQ(send(fd, commands.data(), commands.size(), 0),
+            (ssize_t)commands.size());
+
+  std::string replies;
+  char buffer[1024];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    replies.append(buffer, n);
+  }
+  close(fd);
+
+  EXPECT_EQ(replies, "+OK\r\n"
+                     "$5\r\nvalue\r\n"
+                     "*2\r\n$5\r\nvalue\r\n$-1\r\n"
+                     ":60\r\n"
+                     ":1\r\n"
+                     "$-1\r\n"
+                     "-ERR invalid expire time in 'set' command\r\n"
+                     "+OK\r\n");
+}
+
 int main(int argc, char **argv) {
   testing::InitGoogleTest(&argc, argv);
   curl_global_init(CURL_GLOBAL_DEFAULT);
@@ -0,0 +1,40 @@
+#include "../src/striped_counter.hpp"
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+
+TEST(StripedCounterTest, SumsEveryThreadsCells) {
+  StripedCounter counter;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2 * static_cast<int>(METRIC_STRIPES); t++) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 10000; i++) {
+        counter.increment();
+      }
+      counter.increment(5);
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(counter.value(), 2 * METRIC_STRIPES * 10005);
+}
+
+TEST(StripedCounterTest, ScrapedFamilyReadsAtCollect) {
+  StripedCounter counter;
+  double depth = 3;
+  ScrapedFamily counters("test_total", "Test", prometheus::MetricType::Counter);
+  ScrapedFamily gauges("test_depth", "Test", prometheus::MetricType::Gauge);
+  counters.add({{"kind", "striped"}}, counter);
+  gauges.add({}, [&]() { return depth; });
+
+  counter.increment(7);
+  depth = 4;
+  auto collected = counters.Collect();
+  ASSERT_EQ(collected.size(), 1u);
+  EXPECT_EQ(collected[0].type, prometheus::MetricType::Counter);
+  ASSERT_EQ(collected[0].metric.size(), 1u);
+  EXPECT_EQ(collected[0].metric[0].label[0].name, "kind");
+  EXPECT_EQ(collected[0].metric[0].counter.value, 7);
+  EXPECT_EQ(gauges.Collect()[0].metric[0].gauge.value, 4);
+}
@@ -0,0 +1,90 @@
+#include "../src/timer_wheel.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+TEST(TimerWheelTest, FiresAtExpiryTick) {
+  TimerWheel<int> wheel;
+  wheel.schedule(1, 5);
+  wheel.schedule(2, 70);       // level 1
+  wheel.schedule(3, 5000);     // level 2
+  wheel.schedule(4, 300000);   // level 3
+
+  std::vector<int> fired;
+  auto record = [&](int item) { fired.push_back(item); };
+  EXPECT_TRUE(wheel.advance(4, 1000, record));
+  EXPECT_TRUE(fired.empty());
+  EXPECT_TRUE(wheel.advance(5, 1000, record));
+  EXPECT_EQ(fired, std::vector<int>({1}));
+  EXPECT_TRUE(wheel.advance(69, 1000, record));
+  EXPECT_EQ(fired.size(), 1u);
+  EXPECT_TRUE(wheel.advance(70, 1000, record));
+  EXPECT_TRUE(wheel.advance(4999, 1000, record));
+  EXPECT_EQ(fired, std::vector<int>({1, 2}));
+  EXPECT_TRUE(wheel.advance(300000, 1000, record));
+  EXPECT_EQ(fired, std::vector<int>({1, 2, 3, 4}));
+  EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TimerWheelTest, CancelAndReschedule) {
+  TimerWheel<int> wheel;
+  auto cancelled = wheel.schedule(1, 10);
+  auto moved = wheel.schedule(2, 10);
+  wheel.schedule(3, 0); // already due
+  wheel.cancel(cancelled);
+  wheel.reschedule(moved, 200);
+
+  std::vector<int> fired;
+  auto record = [&](int item) { fired.push_back(item); };
+  EXPECT_TRUE(wheel.advance(100, 1000, record));
+  EXPECT_EQ(fired, std::vector<int>({3}));
+  EXPECT_TRUE(wheel.advance(200, 1000, record));
+  EXPECT_EQ(fired, std::vector<int>({3, 2}));
+}
+
+TEST(TimerWheelTest, AdvancesInBoundedBatches) {
+  TimerWheel<int> wheel;
+  for (int i = 0; i < 1000; i++) {
+    wheel.schedule(i, 4096 + i % 3); // same level-2 slot
+  }
+  size_t fired = 0, calls = 0;
+  bool done = false;
+  while (!done) {
+    size_t before = fired;
+    done = wheel.advance(5000, 64, [&](int) { fired++; });
+    EXPECT_LE(fired - before, 64u);
+    calls++;
+  }
+  EXPECT_EQ(fired, 1000u);
+  EXPECT_GT(calls, 1000u / 64);
+}
+
+TEST(TimerWheelTest, MatchesSortedExpiries) {
+  TimerWheel<uint64_t> wheel(1000);
+  std::mt19937_64 rng(7);
+  std::vector<uint64_t> expiries;
+  for (int i = 0; i < 5000; i++) {
+    uint64_t expiry = 1000 + rng() % 400000;
+    expiries.push_back(expiry);
+    wheel.schedule(expiry, expiry);
+  }
+  uint64_t now = 1000;
+  size_t fired = 0;
+  while (now < 401000) {
+    now += 1 + rng() % 5000;
+    wheel.advance(now, SIZE_MAX, [&](uint64_t expiry) {
+      EXPECT_LE(expiry, now);
+      fired++;
+    });
+    size_t due = 0;
+    for (uint64_t expiry : expiries) {
+      due += expiry <= now;
+    }
+    ASSERT_EQ(fired, due) << "at tick " << now;
+  }
+}
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}